@@ -0,0 +1,61 @@
+#include <source/endian.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace WPN114::Network;
+
+static constexpr size_t
+count = 256,
+iterations = 200000;
+// 256 floats: a large vector or list argument
+
+template<typename _Swap> static double
+measure(_Swap&& swap, char* dst, const char* src)
+// average ns per call
+{
+    // warm up caches and the dispatch
+    for (size_t n = 0; n < 1000; ++n)
+         swap(dst, src, count);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t n = 0; n < iterations; ++n) {
+         swap(dst, src, count);
+         // keeps the compiler from hoisting the call out of the loop
+         asm volatile("" : : "r"(dst) : "memory");
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now()-start;
+    return elapsed.count()/iterations;
+}
+
+int main()
+{
+    // one extra byte on each side, to measure unaligned access as well
+    std::vector<char> src(count*4+1), scalar(count*4+1), vector(count*4+1);
+
+    for (size_t n = 0; n < src.size(); ++n)
+         src[n] = static_cast<char>(n*7+3);
+
+    int failures = 0;
+
+    for (size_t offset = 0; offset < 2; ++offset)
+    {
+        auto s = src.data()+offset;
+
+        auto t_scalar = measure(bswap32_copy_scalar, scalar.data()+offset, s);
+        auto t_vector = measure(bswap32_copy, vector.data()+offset, s);
+
+        if (memcmp(scalar.data()+offset, vector.data()+offset, count*4)) {
+            printf("%s: results differ\n", offset ? "unaligned" : "aligned");
+            failures++;
+        }
+
+        printf("%-9s  %zu floats  scalar %7.1f ns  bswap32_copy %7.1f ns  (x%.1f)\n",
+               offset ? "unaligned" : "aligned", count, t_scalar, t_vector, t_scalar/t_vector);
+    }
+
+    return failures;
+}
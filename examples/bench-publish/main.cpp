@@ -0,0 +1,67 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <cstdio>
+
+#include <source/tree.hpp>
+
+using namespace WPN114::Network;
+
+// time spent on the qt thread publishing namespace snapshots while values stream:
+// 'groups' x 'params' float nodes, 'changes' of them set every millisecond
+
+static constexpr int
+groups = 100,
+params = 100,
+changes = 100,
+duration = 2000;
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    Tree tree;
+    QVector<Node*> nodes;
+
+    for (int g = 0; g < groups; ++g) {
+        for (int p = 0; p < params; ++p) {
+            auto node = tree.find_or_create(QString("/group%1/param%2").arg(g).arg(p));
+            node->set_type(Type::Float);
+            nodes << node;
+        }
+    }
+
+    tree.set_publishing(true);
+
+    auto initial = tree.publishStatistics();
+    printf("%d nodes, %zu bytes of json, first publish %.0f us\n",
+           nodes.size(), size_t(tree.published()->json().size()),
+           initial["averageUsecs"].toDouble());
+
+    int ticks = 0;
+    QTimer stream;
+    stream.setTimerType(Qt::PreciseTimer);
+
+    QObject::connect(&stream, &QTimer::timeout, [&] {
+        for (int n = 0; n < changes; ++n)
+             nodes[(ticks*changes+n) % nodes.size()]->set_value(Value(float(ticks)));
+        ticks++;
+    });
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    stream.start(1);
+
+    QTimer::singleShot(duration, &app, &QCoreApplication::quit);
+    app.exec();
+
+    auto seconds = elapsed.elapsed()/1000.;
+    auto statistics = tree.publishStatistics();
+    auto published = statistics["published"].toULongLong()-initial["published"].toULongLong();
+    auto usecs = statistics["totalUsecs"].toULongLong()-initial["totalUsecs"].toULongLong();
+
+    printf("%d turns with value changes, %llu publishes, %.0f us each, %.1f ms/s on the qt thread\n",
+           ticks, published, published ? double(usecs)/published : 0., usecs/seconds/1000);
+
+    return 0;
+}
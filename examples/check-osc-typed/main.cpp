@@ -0,0 +1,82 @@
+#include <source/osc_typed.hpp>
+#include <source/value.hpp>
+#include <cstdio>
+
+using namespace WPN114::Network;
+
+// OSCTypedMessage against the runtime encoder and decoder: same bytes out of
+// OSCEncoder (QVariant and Value paths), same values back out of OSCView/OSCMessage
+
+static int
+failures = 0;
+
+static void
+check(bool condition, const char* signature, const char* what)
+{
+    if (!condition) {
+        printf("%-6s %s\n", signature, what);
+        failures++;
+    }
+}
+
+template<typename... _Args> static void
+round_trip(const char* signature, Value const& value, _Args... arguments)
+{
+    using Message = OSCTypedMessage<_Args...>;
+    static constexpr std::string_view address = "/source/1/xyz";
+
+    QByteArray typed, variant, valued;
+    Message::encode(typed, address, arguments...);
+
+    check(typed.size() == int(Message::size(address.size())), signature, "constexpr size");
+
+    OSCEncoder::encode(variant, QString::fromUtf8(address.data(), address.size()),
+                       Message::arguments(arguments...), OSCEncoder::DoublePrecision);
+
+    OSCEncoder::encode(valued, address, value);
+
+    check(typed == variant, signature, "differs from OSCEncoder (QVariant)");
+    check(typed == valued, signature, "differs from OSCEncoder (Value)");
+
+    OSCView view(typed.constData(), typed.size());
+    check(view.valid() && view.address() == address, signature, "not a valid OSCView");
+
+    std::tuple<_Args...> decoded;
+    bool matched = std::apply([&](auto&... fields) {
+        return Message::decode(view, fields...);
+    }, decoded);
+
+    check(matched, signature, "signature doesn't match");
+    check(decoded == std::make_tuple(arguments...), signature, "decoded values differ");
+
+    OSCMessage message(typed);
+    QByteArray reencoded;
+    OSCEncoder::encode(reencoded, message.m_method, message.m_arguments, OSCEncoder::DoublePrecision);
+
+    check(message.m_arguments == Message::arguments(arguments...), signature, "OSCMessage arguments differ");
+    check(reencoded == typed, signature, "OSCMessage doesn't re-encode it as is");
+    check(Value::from_osc(view, value.type()).to_variant() == value.to_variant(), signature, "Value differs");
+}
+
+int main()
+{
+    float xyz[3] = { 0.25f, -1.5f, 1024.f }, xyzw[4] = { 1.f, 2.f, 3.f, 4.f };
+
+    round_trip("i",    Value(int32_t(-42)), int32_t(-42));
+    round_trip("f",    Value(0.125f), 0.125f);
+    round_trip("h",    Value(int64_t(1) << 40), int64_t(1) << 40);
+    round_trip("d",    Value(3.141592653589793), 3.141592653589793);
+    round_trip("ff",   Value::vec(xyz, 2), xyz[0], xyz[1]);
+    round_trip("fff",  Value::vec(xyz, 3), xyz[0], xyz[1], xyz[2]);
+    round_trip("ffff", Value::vec(xyzw, 4), xyzw[0], xyzw[1], xyzw[2], xyzw[3]);
+
+    // another signature doesn't decode
+    QByteArray packet;
+    OSCTypedMessage<float, float, float>::encode(packet, "/xyz", 1.f, 2.f, 3.f);
+    float x, y;
+    check(!OSCTypedMessage<float, float>::decode(OSCView(packet.constData(), packet.size()), x, y),
+          "ff", "decoded a ',fff' message");
+
+    printf("%s\n", failures ? "failed" : "ok");
+    return failures;
+}
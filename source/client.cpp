@@ -62,12 +62,12 @@ connect()
     if (m_host.startsWith("ws://")) {
         if (m_host.contains(":")) {
             m_port = std::stoi(m_host.split("/").last().toStdString());
-            m_connection = mg_connect_ws(&m_mgr, event_handler, CSTR(m_host), nullptr, nullptr);
+            m_connection = Connection(mg_connect_ws(&m_mgr, event_handler, CSTR(m_host), nullptr, nullptr), &m_outbox);
         } else {
             QString addr(m_host);
             addr.append(":");
             addr.append(QString::number(m_port));
-            m_connection = mg_connect_ws(&m_mgr, event_handler, CSTR(addr), nullptr, nullptr);
+            m_connection = Connection(mg_connect_ws(&m_mgr, event_handler, CSTR(addr), nullptr, nullptr), &m_outbox);
         }
     } else {
         QString addr("ws://");
@@ -78,9 +78,10 @@ connect()
             addr.append(QString::number(m_port));
         }
 
-        m_connection = mg_connect_ws(&m_mgr, event_handler, CSTR(addr), nullptr, nullptr);
+        m_connection = Connection(mg_connect_ws(&m_mgr, event_handler, CSTR(addr), nullptr, nullptr), &m_outbox);
     }
 
+    m_outbox.open(m_mgr, this);
     m_running = true;
     m_thread = std::thread(&Client::poll, this);
 }
@@ -121,16 +122,24 @@ void
 WPN114::Network::Client::
 send(QString uri, QVariant arguments, bool critical)
 {
-    OSCMessage message(uri, arguments);
-    m_connection.writeOSC(uri, arguments.toList(), critical);
+    m_connection.write_osc(uri, arguments, critical);
+}
+
+void
+WPN114::Network::Client::
+sendBundle(QVariantMap messages, bool critical)
+{
+    m_connection.writeBundle(messages, critical);
 }
 
 void
 WPN114::Network::Client::
 poll()
 {
-    while (m_running)
+    while (m_running) {
            mg_mgr_poll(&m_mgr, 200);
+           m_outbox.flush(m_mgr);
+    }
 }
 
 void
@@ -153,11 +162,8 @@ parse_json(const QByteArray &frame)
         auto data = object["DATA"].toObject();
 
         if (type == "PATH_ADDED") {
-            for (auto& key : data.keys()) {
-                auto objn = data[key].toObject();
-                auto node = m_tree.find_or_create(objn["FULL_PATH"].toString());
-                node->update(objn);
-            }
+            for (auto& key : data.keys())
+                 m_tree.mirror(data[key].toObject());
         }
 
         else if (type == "PATH_REMOVED") {
@@ -167,7 +173,8 @@ parse_json(const QByteArray &frame)
 
     else if (object.contains("FULL_PATH"))
     {
-
+        // namespace reply: nodes are only created once asked for
+        m_tree.mirror(object);
     }
 
     else if (object.contains("OSC_PORT"))
@@ -186,15 +193,6 @@ parse_json(const QByteArray &frame)
     }
 }
 
-void
-WPN114::Network::Client::
-parse_osc(const QByteArray &data)
-{
-    OSCMessage msg(data);
-    if (auto node = m_tree.find(msg.m_method))
-        node->set_value(msg.m_arguments);
-}
-
 void
 WPN114::Network::Client::
 on_http_reply(http_message *reply)
@@ -207,22 +205,21 @@ void
 WPN114::Network::Client::
 on_websocket_frame(websocket_message *message)
 {
-    QByteArray frame(reinterpret_cast<const char*>(message->data), message->size);
+    auto data = reinterpret_cast<const char*>(message->data);
 
     if (message->flags & WEBSOCKET_OP_TEXT)
-        parse_json(frame);
+        parse_json(QByteArray(data, message->size));
 
     else if (message->flags & WEBSOCKET_OP_BINARY)
-        parse_osc(frame);
+        parse_osc(data, message->size);
 }
 
 void
 WPN114::Network::Client::
 on_udp_datagram(mg_connection *connection)
 {
-    QByteArray cdg(connection->recv_mbuf.buf,
-                   connection->recv_mbuf.len);
-    parse_osc(cdg);
+    parse_osc(connection->recv_mbuf.buf,
+              connection->recv_mbuf.len);
 }
 
 void
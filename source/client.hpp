@@ -79,6 +79,11 @@ public:
     Q_INVOKABLE void
     send(QString uri, QVariant arguments, bool critical = true);
 
+    //-------------------------------------------------------------------------------------------------
+    Q_INVOKABLE void
+    sendBundle(QVariantMap messages, bool critical = true);
+    // sends many 'path: value' updates at once, packed as OSC bundles
+
 private:
 
     void
@@ -97,9 +102,6 @@ private:
     void
     parse_json(QByteArray const& frame);
 
-    void
-    parse_osc(QByteArray const& data);
-
     //-------------------------------------------------------------------------------------------------
     Q_INVOKABLE void
     on_http_reply(http_message* reply);
@@ -0,0 +1,128 @@
+#include "endian.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define WPN114_ENDIAN_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define WPN114_ENDIAN_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define WPN114_ENDIAN_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace WPN114::Network;
+
+static inline uint32_t
+bswap32(uint32_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_bswap32(value);
+#else
+    return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+#endif
+}
+
+void
+WPN114::Network::
+bswap32_copy_scalar(void* dst, const void* src, size_t count)
+{
+    auto s = static_cast<const char*>(src);
+    auto d = static_cast<char*>(dst);
+
+    for (size_t n = 0; n < count; ++n) {
+        uint32_t word;
+        memcpy(&word, s+n*4, 4);
+        word = bswap32(word);
+        memcpy(d+n*4, &word, 4);
+    }
+}
+
+#ifdef WPN114_ENDIAN_AVX2
+__attribute__((target("avx2"))) static void
+bswap32_copy_avx2(char* d, const char* s, size_t count)
+{
+    const __m256i mask = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    size_t n = 0;
+
+    for (; n+16 <= count; n += 16) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s+n*4));
+        auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s+n*4+32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d+n*4), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d+n*4+32), _mm256_shuffle_epi8(b, mask));
+    }
+
+    for (; n+8 <= count; n += 8) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s+n*4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d+n*4), _mm256_shuffle_epi8(a, mask));
+    }
+
+    bswap32_copy_scalar(d+n*4, s+n*4, count-n);
+}
+
+static bool
+has_avx2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+#ifdef WPN114_ENDIAN_SSE2
+static void
+bswap32_copy_sse2(char* d, const char* s, size_t count)
+{
+    size_t n = 0;
+
+    for (; n+4 <= count; n += 4) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+n*4));
+        // swap bytes within 16-bit lanes, then swap the 16-bit halves of each word
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d+n*4), v);
+    }
+
+    bswap32_copy_scalar(d+n*4, s+n*4, count-n);
+}
+#endif
+
+#ifdef WPN114_ENDIAN_NEON
+static void
+bswap32_copy_neon(char* d, const char* s, size_t count)
+{
+    size_t n = 0;
+
+    for (; n+4 <= count; n += 4) {
+        auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(s+n*4));
+        vst1q_u8(reinterpret_cast<uint8_t*>(d+n*4), vrev32q_u8(v));
+    }
+
+    bswap32_copy_scalar(d+n*4, s+n*4, count-n);
+}
+#endif
+
+void
+WPN114::Network::
+bswap32_copy(void* dst, const void* src, size_t count)
+{
+    auto s = static_cast<const char*>(src);
+    auto d = static_cast<char*>(dst);
+
+#if defined(WPN114_ENDIAN_AVX2)
+    if (count >= 8 && has_avx2())
+        return bswap32_copy_avx2(d, s, count);
+#endif
+#if defined(WPN114_ENDIAN_SSE2)
+    bswap32_copy_sse2(d, s, count);
+#elif defined(WPN114_ENDIAN_NEON)
+    bswap32_copy_neon(d, s, count);
+#else
+    bswap32_copy_scalar(d, s, count);
+#endif
+}
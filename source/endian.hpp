@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+// bulk 32-bit byte swapping, for contiguous runs of 'f'/'i' OSC arguments
+// uses AVX2 (selected at runtime), SSE2 or NEON when available, scalar code otherwise
+//=================================================================================================
+
+void
+bswap32_copy(void* dst, const void* src, size_t count);
+// copies 'count' 32-bit words from 'src' to 'dst', swapping their byte order
+// 'src' and 'dst' may be unaligned, but shouldn't overlap
+
+void
+bswap32_copy_scalar(void* dst, const void* src, size_t count);
+// reference implementation
+
+}
+}
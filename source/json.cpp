@@ -0,0 +1,69 @@
+#include "json.hpp"
+#include "tree.hpp"
+
+using namespace WPN114::Network;
+
+WPN114::Network::JsonTreeWriter::
+JsonTreeWriter(Tree& tree, Node& node) :
+    m_tree(&tree)
+{
+    open(m_pending, node);
+    m_end = m_pending.size();
+}
+
+void
+WPN114::Network::JsonTreeWriter::
+open(QByteArray& out, Node& node)
+{
+    if (node.json_cached() || !node.id()) {
+        // copied out chunk by chunk, holding a reference rather than a copy
+        m_pending = node.json();
+        m_offset = 0;
+        m_end = m_pending.size();
+        return;
+    }
+
+    node.append_json_head(out);
+    m_stack.push_back({ node.id(), 0 });
+}
+
+void
+WPN114::Network::JsonTreeWriter::
+write(QByteArray& out, int max)
+{
+    while (out.size() < max)
+    {
+        if (m_offset < m_end)
+        {
+            auto n = qMin(m_end-m_offset, max-out.size());
+            out.append(m_pending.constData()+m_offset, n);
+            m_offset += n;
+            continue;
+        }
+
+        m_pending.clear();
+        m_offset = 0;
+        m_end = 0;
+
+        if (m_stack.isEmpty())
+            return;
+
+        auto& frame = m_stack.last();
+        auto node = m_tree->node(frame.id);
+
+        if (!node || frame.next >= node->nsubnodes()) {
+            // node is complete, or has been removed in the meantime
+            out.append("}}");
+            m_stack.removeLast();
+            continue;
+        }
+
+        auto subnode = node->subnodes()[frame.next++];
+        if (frame.next > 1)
+            out.append(',');
+
+        append_json_string(out, subnode->name());
+        out.append(':');
+        open(out, *subnode);
+    }
+}
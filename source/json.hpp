@@ -0,0 +1,121 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+// helpers for writing JSON text by hand, when going through QJsonDocument would mean
+// rebuilding a whole object tree just to serialize it
+//=================================================================================================
+
+inline void
+append_json_string(QByteArray& out, const char* utf8, int size)
+// appends a quoted, escaped JSON string
+{
+    static const char* hex = "0123456789abcdef";
+    out.append('"');
+
+    auto run = utf8;
+    for (auto c = utf8; c < utf8+size; ++c)
+    {
+        auto uc = static_cast<unsigned char>(*c);
+        if (uc >= 0x20 && uc != '"' && uc != '\\')
+            continue;
+
+        out.append(run, c-run);
+        run = c+1;
+
+        switch (uc) {
+        case '"':   out.append("\\\""); break;
+        case '\\':  out.append("\\\\"); break;
+        case '\n':  out.append("\\n");  break;
+        case '\r':  out.append("\\r");  break;
+        case '\t':  out.append("\\t");  break;
+        default:
+            out.append("\\u00");
+            out.append(hex[uc >> 4]);
+            out.append(hex[uc & 15]);
+        }
+    }
+
+    out.append(run, utf8+size-run);
+    out.append('"');
+}
+
+inline void
+append_json_string(QByteArray& out, QString const& string)
+{
+    auto utf8 = string.toUtf8();
+    append_json_string(out, utf8.constData(), utf8.size());
+}
+
+class Tree;
+class Node;
+
+//=================================================================================================
+class JsonTreeWriter
+//=================================================================================================
+// resumable, depth-first serializer for a node and its contents, producing bounded chunks:
+// unchanged branches are copied from the nodes' cached json, others are written on the fly.
+// nodes are held by id, so the tree may change in between two calls to write()
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    JsonTreeWriter(Tree& tree, Node& node);
+
+    JsonTreeWriter(QByteArray const& document) :
+        m_pending(document), m_end(document.size()) {}
+    // a document that has already been serialized, written as is
+
+    JsonTreeWriter(QByteArray const& document, int begin, int end) :
+        m_pending(document), m_offset(begin), m_end(end) {}
+    // a slice of it, e.g. a node in a NamespaceSnapshot, written without being copied first
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    done() const { return m_stack.isEmpty() && m_offset >= m_end; }
+
+    //---------------------------------------------------------------------------------------------
+    void
+    write(QByteArray& out, int max);
+    // appends to 'out' until it holds 'max' bytes or the document is complete,
+    // overshooting by no more than a single node's attributes
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    void
+    open(QByteArray& out, Node& node);
+
+    //---------------------------------------------------------------------------------------------
+    struct Frame
+    {
+        uint32_t
+        id;
+
+        int
+        next;
+    };
+
+    Tree*
+    m_tree = nullptr;
+
+    QVector<Frame>
+    m_stack;
+    // nodes whose contents are being written, along with the next subnode to write
+
+    QByteArray
+    m_pending;
+
+    int
+    m_offset = 0,
+    m_end = 0;
+};
+
+}
+}
@@ -2,16 +2,17 @@
 #include "osc.hpp"
 
 #include <QJsonDocument>
+#include <QTimer>
 
 using namespace WPN114::Network;
 
 WPN114::Network::Connection::
-Connection(mg_connection* ws_connection) :
-    m_ws_connection(ws_connection)
+Connection(mg_connection* ws_connection, Outbox* outbox) :
+    m_ws_connection(ws_connection), m_outbox(outbox)
 {
-    char addr[32], port[5];
+    char addr[48], port[8];
     mg_sock_addr_to_str(&ws_connection->sa, addr, sizeof(addr), MG_SOCK_STRINGIFY_IP);
-    mg_sock_addr_to_str(&ws_connection->sa, addr, sizeof(addr), MG_SOCK_STRINGIFY_PORT);
+    mg_sock_addr_to_str(&ws_connection->sa, port, sizeof(port), MG_SOCK_STRINGIFY_PORT);
 
     m_host_ip = addr;
     m_host_ip.append(":");
@@ -22,53 +23,236 @@ void
 WPN114::Network::Connection::
 set_udp(uint16_t udp)
 {
+    // read from the websocket now that it is connected (clients create theirs beforehand)
+    char addr[48];
+    mg_sock_addr_to_str(&m_ws_connection->sa, addr, sizeof(addr), MG_SOCK_STRINGIFY_IP);
+
     m_udp_port = udp;
-    m_host_udp = m_host_ip;
+    m_host_udp = addr;
     m_host_udp.prepend("udp://");
     m_host_udp.append(":");
     m_host_udp.append(QString::number(m_udp_port));
+    m_udp_address = m_host_udp.toUtf8();
+
+    if (m_outbox) {
+        Outbox::Packet open;
+        open.kind = Outbox::Kind::Open;
+        open.address = m_udp_address;
+        m_outbox->push(std::move(open));
+    }
+}
+
+void
+WPN114::Network::Connection::
+close()
+{
+    if (m_outbox && !m_host_udp.isEmpty()) {
+        Outbox::Packet close;
+        close.kind = Outbox::Kind::Close;
+        close.address = m_udp_address;
+        m_outbox->push(std::move(close));
+    }
+
+    m_host_udp.clear();
+    m_udp_address.clear();
 
-    mg_mgr_init(&m_mgr, this);
+    // mongoose may hand the same address to a later connection
+    m_ws_connection = nullptr;
 }
 
 void WPN114::Network::Connection::
-on_value_changed(QVariant value)
+on_value_changed(QVariant)
+// encoded from the node's typed value, the QVariant is only there for the signal's sake
 {
-    auto node = qobject_cast<Node*>(QObject::sender());
-    writeOSC(node->path(), value.toList(), node->critical());
+    auto node  = qobject_cast<Node*>(QObject::sender());
+    auto flags = node->type() == Type::Double ? OSCEncoder::DoublePrecision : 0;
+    auto& address = node->address();
+
+    write_encoded(node->critical(), [&](QByteArray& buffer) -> QByteArray& {
+        return OSCEncoder::encode(buffer,
+               std::string_view(address.constData(), address.size()),
+               node->typed_value(), flags);
+    });
 }
 
 void
 WPN114::Network::Connection::
 writeOSC(QString method, QVariantList arguments, bool critical)
 {
-    OSCMessage msg(method, arguments);
-    auto b_arr = msg.encode();
+    write_osc(method, arguments, critical);
+}
+
+void
+WPN114::Network::Connection::
+write_osc(QString const& method, QVariant const& arguments, bool critical)
+{
+    write_encoded(critical, [&](QByteArray& buffer) -> QByteArray& {
+        return OSCEncoder::encode(buffer, method, arguments);
+    });
+}
+
+void
+WPN114::Network::Connection::
+writeBundle(QVariantMap messages, bool critical)
+{
+    auto& buffer = OSCEncoder::local_buffer();
+    buffer.resize(0);
+
+    OSCBundleWriter bundle(buffer);
+
+    for (auto it = messages.cbegin(); it != messages.cend(); ++it)
+    {
+        auto mark = buffer.size();
+        bundle.append(it.key(), it.value());
+
+        if (!critical && buffer.size() > max_datagram_size && bundle.count() > 1) {
+            // doesn't fit: send what we have and start over with this message
+            buffer.resize(mark);
+            send(buffer, critical);
+            bundle.reset();
+            bundle.append(it.key(), it.value());
+        }
+    }
+
+    if (bundle.count())
+        send(buffer, critical);
+}
 
+Outbox::Packet*
+WPN114::Network::Connection::
+acquire(bool critical)
+{
     if (critical) {
-         mg_send_websocket_frame(m_ws_connection, WEBSOCKET_OP_BINARY,
-                                 b_arr.data(), b_arr.count());
-    } else {
-        m_udp_connection = mg_connect(&m_mgr, CSTR(m_host_udp), nullptr);
-        mg_send(m_udp_connection, b_arr.data(), b_arr.count());
+        if (!m_ws_connection)
+            return nullptr;
+
+        auto packet = m_outbox->acquire();
+        packet->connection = m_ws_connection;
+        packet->kind = Outbox::Kind::Binary;
+        return packet;
     }
+
+    if (m_host_udp.isEmpty())
+        return nullptr;
+
+    auto packet = m_outbox->acquire();
+    packet->kind = Outbox::Kind::Datagram;
+    packet->address = m_udp_address;
+    return packet;
 }
 
 void
 WPN114::Network::Connection::
-writeText(QString text)
+send(QByteArray const& packet, bool critical)
 {
-    auto utf8 = text.toUtf8();
-    mg_send_websocket_frame(m_ws_connection, WEBSOCKET_OP_TEXT,
-                            utf8.data(), utf8.count());
+    // udp senders live on the polling thread, there are none without an outbox
+    if (!m_outbox)
+        return write_frame(packet, Outbox::Kind::Binary);
 
+    if (auto target = acquire(critical)) {
+        target->data.append(packet);
+        m_outbox->push(target);
+    }
+}
+
+void
+WPN114::Network::Connection::
+write_frame(QByteArray const& frame, Outbox::Kind kind)
+{
+    if (!m_ws_connection)
+        return;
+
+    if (m_outbox) {
+        auto packet = m_outbox->acquire();
+        packet->connection = m_ws_connection;
+        packet->kind = kind;
+        packet->data.append(frame);
+        m_outbox->push(packet);
+    }
+    else mg_send_websocket_frame(m_ws_connection,
+            kind == Outbox::Kind::Binary ? WEBSOCKET_OP_BINARY : WEBSOCKET_OP_TEXT,
+            frame.constData(), frame.size());
+}
+
+void
+WPN114::Network::Connection::
+writeText(QString text)
+{
+    write_frame(text.toUtf8(), Outbox::Kind::Text);
 }
 
 void
 WPN114::Network::Connection::
 writeJson(QJsonObject object)
 {
-    auto doc = QJsonDocument(object).toJson(QJsonDocument::Compact);
-    mg_send_websocket_frame(m_ws_connection, WEBSOCKET_OP_TEXT,
-                            doc.data(), doc.count());
+    write_json(QJsonDocument(object).toJson(QJsonDocument::Compact));
+}
+
+void
+WPN114::Network::Connection::
+write_json(QByteArray const& json)
+{
+    write_frame(json, Outbox::Kind::Text);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+QVariantMap
+WPN114::Network::NetworkDevice::
+outboxStatistics() const
+{
+    auto& counters = m_outbox.counters();
+
+    qulonglong
+    frames  = counters.frames.load(),
+    packets = counters.packets.load();
+
+    return QVariantMap {
+        { "frames", frames },
+        { "packets", packets },
+        { "packetsPerFrame", frames ? double(packets)/frames : 0. }
+    };
+}
+
+void
+WPN114::Network::NetworkDevice::
+parse_osc(const char* data, size_t size)
+{
+    OSCPacket::parse(data, size, [this](OSCView const& message, uint64_t timetag) {
+        dispatch_osc(message, timetag);
+    });
+}
+
+void
+WPN114::Network::NetworkDevice::
+dispatch_osc(OSCView const& message, uint64_t timetag)
+{
+    auto delay = OSCTimetag::delay(timetag);
+
+    if (delay == 0) {
+        on_osc_message(message);
+        return;
+    }
+
+    // keep a copy of the message until it is due
+    QByteArray copy(message.data(), message.size());
+    QTimer::singleShot(delay, this, [this, copy] {
+        on_osc_message(OSCView(copy.constData(), copy.size()));
+    });
+}
+
+void
+WPN114::Network::NetworkDevice::
+on_osc_message(OSCView const& message)
+{
+    if (OSCPattern::is_pattern(message.address())) {
+        // copy (shared) in case an update changes the tree structure
+        auto const nodes = m_tree.match(message.method());
+        for (const auto& node : nodes)
+             node->set_value(Value::from_osc(message, node->type()));
+    }
+
+    else if (auto id = m_tree.find_id(message.address()))
+        // mirrored nodes may not have been loaded, their record is updated instead
+        m_tree.set_value(id, message);
 }
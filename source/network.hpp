@@ -3,6 +3,8 @@
 #include <QObject>
 
 #include <source/tree.hpp>
+#include <source/osc.hpp>
+#include <source/outbox.hpp>
 #include <dependencies/mongoose/mongoose.h>
 #include <dependencies/qzeroconf/qzeroconf.h>
 
@@ -25,21 +27,27 @@ public:
 
     Connection() {}
 
-    Connection(mg_connection* ws_connection);
+    Connection(mg_connection* ws_connection, Outbox* outbox = nullptr);
+    // with an outbox, packets are sent by the device's polling thread
+    // and can be written from any thread
 
     Connection(Connection const& cp) :
         m_ws_connection     (cp.m_ws_connection),
-        m_udp_connection    (cp.m_udp_connection),
+        m_outbox            (cp.m_outbox),
         m_udp_port          (cp.m_udp_port),
-        m_host_ip           (cp.m_host_ip) {}
+        m_host_ip           (cp.m_host_ip),
+        m_host_udp          (cp.m_host_udp),
+        m_udp_address       (cp.m_udp_address) {}
 
     Connection&
     operator=(Connection const& cp)
     {
         m_ws_connection     = cp.m_ws_connection;
-        m_udp_connection    = cp.m_udp_connection;
+        m_outbox            = cp.m_outbox;
         m_udp_port          = cp.m_udp_port;
         m_host_ip           = cp.m_host_ip;
+        m_host_udp          = cp.m_host_udp;
+        m_udp_address       = cp.m_udp_address;
 
         return *this;
     }
@@ -49,11 +57,17 @@ public:
 
     //---------------------------------------------------------------------------------------------
     mg_connection*
-    mgc() { return m_ws_connection; }
+    mgc() const { return m_ws_connection; }
+    // null once closed
 
     //---------------------------------------------------------------------------------------------
     void
     set_udp(uint16_t udp);
+    // opens a udp sender towards the peer's port, reused for every non-critical packet
+
+    void
+    close();
+    // closes the udp sender and forgets the websocket, everything is dropped from then on
 
     //-------------------------------------------------------------------------------------------------
     Q_INVOKABLE
@@ -67,22 +81,63 @@ public:
     Q_INVOKABLE void
     writeOSC(QString method, QVariantList arguments, bool critical = false);
 
+    void
+    write_osc(QString const& method, QVariant const& arguments, bool critical = false);
+    // encodes into the thread's reusable buffer, scalar values are sent as is
+
+    //-------------------------------------------------------------------------------------------------
+    Q_INVOKABLE void
+    writeBundle(QVariantMap messages, bool critical = false);
+    // packs 'path: value' pairs into as few OSC bundles as possible,
+    // non-critical bundles are split to stay below max_datagram_size
+
     Q_INVOKABLE void
     writeText(QString text);
 
+    void
+    send(QByteArray const& packet, bool critical);
+    // 'packet' is copied into one of the outbox's pooled buffers
+
     Q_INVOKABLE void
     writeJson(QJsonObject object);
 
+    void
+    write_json(QByteArray const& json);
+    // an already serialized command, e.g. serialized once for several connections
+
+    //-------------------------------------------------------------------------------------------------
+    static constexpr int
+    max_datagram_size = 1400;
+    // keeps udp bundles below a typical ethernet/wifi MTU
+
 private:
 
-    mg_connection*
-    m_udp_connection = nullptr;
+    Outbox::Packet*
+    acquire(bool critical);
+    // outbox packet for a binary frame or a datagram, null if there is nowhere to send it to
+
+    template<typename _Encode> void
+    write_encoded(bool critical, _Encode&& encode)
+    // encodes straight into an outbox packet, or into the thread's buffer without an outbox.
+    // 'encode' takes the buffer to write to and returns it
+    {
+        if (!m_outbox)
+            write_frame(encode(OSCEncoder::local_buffer()), Outbox::Kind::Binary);
+
+        else if (auto packet = acquire(critical)) {
+            encode(packet->data);
+            m_outbox->push(packet);
+        }
+    }
+
+    void
+    write_frame(QByteArray const& frame, Outbox::Kind kind);
 
     mg_connection*
     m_ws_connection = nullptr;
 
-    mg_mgr
-    m_mgr;
+    Outbox*
+    m_outbox = nullptr;
 
     uint16_t
     m_udp_port = 0;
@@ -90,6 +145,10 @@ private:
     QString
     m_host_ip,
     m_host_udp;
+
+    QByteArray
+    m_udp_address;
+    // m_host_udp, as the outbox expects it
 };
 
 //=================================================================================================
@@ -115,19 +174,32 @@ public:
     //---------------------------------------------------------------------------------------------
     Q_INVOKABLE Node*
     get(QString path) { return m_tree.find(path); }
+    // mirrored nodes are created on demand, along with their siblings
 
     Q_INVOKABLE Tree*
     tree() { return &m_tree; }
 
+    Q_INVOKABLE QVariantMap
+    outboxStatistics() const;
+    // websocket frames sent, along with how many packets each of them held on average
+
     //---------------------------------------------------------------------------------------------
     Q_INVOKABLE QVariant
-    value(QString path)
+    value(QString path) { return m_tree.value(path); }
+
     //---------------------------------------------------------------------------------------------
-    {
-        if  (auto node = m_tree.find(path))
-             return node->value();
-        else return QVariant();
-    }
+    Q_INVOKABLE int
+    id(QString path) { return m_tree.id(path); }
+    // resolve a path once, then use its integer id for repeated access
+
+    Q_INVOKABLE Node*
+    node(int id) { return m_tree.node(id); }
+
+    Q_INVOKABLE QVariant
+    value_at(int id) { return m_tree.value(id); }
+
+    Q_INVOKABLE void
+    set_value_at(int id, QVariant value) { m_tree.set_value(id, value); }
 
     // --------------------------------------------------------------------------------------------
     QQmlListProperty<Node>
@@ -196,12 +268,30 @@ public:
 
 protected:
 
+    //---------------------------------------------------------------------------------------------
+    void
+    parse_osc(const char* data, size_t size);
+    // unpacks messages and bundles, messages with a future timetag are scheduled
+
+    void
+    dispatch_osc(OSCView const& message, uint64_t timetag);
+    // applies message now, or schedules it if 'timetag' is in the future
+
+    virtual void
+    on_osc_message(OSCView const& message);
+    // applies message to the matching node
+
+    //---------------------------------------------------------------------------------------------
     Tree
     m_tree;
 
     QZeroConf
     m_zeroconf;
 
+    Outbox
+    m_outbox;
+    // drained by the device's polling thread
+
 };
 
 }
@@ -1,8 +1,18 @@
 #include "node.hpp"
 #include "tree.hpp"
+#include "json.hpp"
+#include <QColor>
+#include <QJsonDocument>
+#include <QMetaMethod>
+#include <QVarLengthArray>
 
 using namespace WPN114::Network;
 
+static thread_local QVarLengthArray<QPair<void*, Tree*>, 4>
+s_pooled;
+// pooled nodes being deleted on this thread: their destructor can still tell which tree
+// they came from, operator delete no longer can
+
 WPN114::Network::Node::Node(Node& parent, QString name, Type::Values type) :
     m_type          (type),
     m_name          (name),
@@ -13,6 +23,8 @@ WPN114::Network::Node::Node(Node& parent, QString name, Type::Values type) :
          m_path = parent.path().append(name);
     else m_path = parent.path().append('/').append(name);
 
+    m_address = m_path.toUtf8();
+
     // prevents qml from destroying nodes when referenced in javascript functions
     QQmlEngine::setObjectOwnership(this, QQmlEngine::CppOwnership);
 }
@@ -26,9 +38,72 @@ Node(QJsonObject const& object)
 WPN114::Network::Node::
 ~Node()
 {
+    if (m_tree) {
+        m_tree->unindex(this, false);
+        if (!m_expanded)
+            m_tree->release_records(m_id);
+    }
+
     if (!m_zombie)
         for (auto& subnode : m_subnodes)
              delete subnode;
+
+    // last thing before operator delete, short of qobject children deleted by ~QObject,
+    // which push and pop their own entries on top of this one
+    if (m_allocator)
+        s_pooled.push_back({ this, m_allocator });
+}
+
+void
+WPN114::Network::Node::
+operator delete(void* node)
+{
+    if (!s_pooled.isEmpty() && s_pooled.last().first == node) {
+        auto tree = s_pooled.last().second;
+        s_pooled.removeLast();
+        tree->release_node(node);
+    }
+    else ::operator delete(node);
+}
+
+void
+WPN114::Network::Node::
+set_id(uint32_t id, uint32_t atom)
+{
+    m_id = id;
+    m_atom = atom;
+
+    // share the interned string rather than keeping a copy per node
+    if (m_tree && atom)
+        m_name = m_tree->atom_name(atom);
+}
+
+void
+WPN114::Network::Node::
+set_name(QString name)
+{
+    m_name = name;
+    invalidate_json();
+
+    if (m_tree && m_id) {
+        m_atom = m_tree->atom(name);
+        m_name = m_tree->atom_name(m_atom);
+    }
+}
+
+void
+WPN114::Network::Node::
+set_path(QString path)
+{
+    // keep the tree's path index up to date if we're part of it
+    auto indexed = m_tree && m_tree->unindex(this, false);
+
+    m_path = path;
+    m_address = path.toUtf8();
+    invalidate_json();
+
+    if (indexed)
+        m_tree->index(this, false);
 }
 
 void
@@ -50,10 +125,10 @@ WPN114::Network::Node::
 setTarget(QQmlProperty const& target)
 // bind node to qml property, taking its type and value
 {
-    m_target    = target;
-    m_value     = target.read();
+    m_target = target;
 
     set_type(static_cast<QMetaType::Type>(target.propertyType()));
+    set_value(target.read());
     m_target.connectNotifySignal(this, SLOT(on_property_changed()));
 }
 
@@ -61,20 +136,14 @@ void
 WPN114::Network::Node::
 on_property_changed()
 {
-    auto value = m_target.read();
-    valueReceived(value);
-
-    if (value != m_value) {
-        valueChanged(value);
-        m_value = value;
-    }
+    set_value(m_target.read());
 }
 
 QString
 WPN114::Network::Node::
-typetag() const
+typetag(Type::Values type)
 {
-    switch (m_type)
+    switch (type)
     {
     case Type::Bool:        return "T";
     case Type::Char:        return "c";
@@ -87,25 +156,46 @@ typetag() const
     case Type::Vec2f:       return "ff";
     case Type::Vec3f:       return "fff";
     case Type::Vec4f:       return "ffff";
+    case Type::Int64:       return "h";
+    case Type::Double:      return "d";
+    case Type::Timetag:     return "t";
+    case Type::Midi:        return "m";
+    case Type::Blob:        return "b";
+    case Type::Color:       return "r";
     default:                return "";
     }
 }
 
 QJsonValue
 WPN114::Network::Node::
-value_json() const
+value_json(Type::Values type, Value const& typed_value)
 {
-    switch (m_type)
+    auto value = typed_value.to_variant();
+
+    switch (type)
     {
-    case Type::Bool:        return m_value.toBool();
-    case Type::Char:        return m_value.toString();
-    case Type::Float:       return m_value.toFloat();
-    case Type::Int:         return m_value.toInt();
-    case Type::String:      return m_value.toString();
+    case Type::Bool:        return value.toBool();
+    case Type::Char:        return value.toString();
+    case Type::Float:       return value.toFloat();
+    case Type::Int:         return value.toInt();
+    case Type::String:      return value.toString();
+    case Type::Int64:       return value.toLongLong();
+    case Type::Double:      return value.toDouble();
+    case Type::Timetag:     return static_cast<double>(value.toULongLong());
+    case Type::Midi:        return static_cast<qint64>(value.toUInt());
+    case Type::Blob:        return QString::fromLatin1(value.toByteArray().toBase64());
+    case Type::Color:       return value.value<QColor>().name(QColor::HexArgb);
     case Type::Vec2f:
     case Type::Vec3f:
     case Type::Vec4f:
-    case Type::List:        return QJsonArray::fromVariantList(m_value.toList());
+    {
+        // straight from the typed value, QVectorND variants don't convert to lists
+        QJsonArray array;
+        for (int n = 0; n < typed_value.width(); ++n)
+             array << typed_value.vec()[n];
+        return array;
+    }
+    case Type::List:        return QJsonArray::fromVariantList(value.toList());
     case Type::None:
     case Type::Impulse:
     default:                return QJsonValue();
@@ -113,22 +203,60 @@ value_json() const
 
 }
 
+void
+WPN114::Network::Node::
+set_type(Type::Values type)
+{
+    m_type = type;
+    on_type_changed();
+}
+
 void
 WPN114::Network::Node::
 set_type(QString const type)
 // sets node value type (OSCtypetag variant)
 {
-    if (type == "f")            m_type = Type::Float;
+    m_type = type_from_tag(type);
+    on_type_changed();
+}
+
+void
+WPN114::Network::Node::
+on_type_changed()
+{
+    // keep the value in the node's new representation
+    if (!m_stored && m_value.type() != m_type)
+        m_value = Value::from_variant(m_value.to_variant(), m_type);
+
+    invalidate_json();
+
+    if (m_tree && m_id)
+        m_tree->update_storage(this);
+}
+
+Type::Values
+WPN114::Network::Node::
+type_from_tag(QString const& type)
+{
+    if (type == "f")            return Type::Float;
     else if (type == "T" ||
-             type == "F")       m_type = Type::Bool;
-    else if (type == "i")       m_type = Type::Int;
-    else if (type == "I")       m_type = Type::Impulse;
-    else if (type == "s")       m_type = Type::String;
-    else if (type == "ff")      m_type = Type::Vec2f;
-    else if (type == "fff")     m_type = Type::Vec3f;
-    else if (type == "ffff")    m_type = Type::Vec4f;
-    else if (type == "N")       m_type = Type::Impulse;
-    else                        m_type = Type::None;
+             type == "F")       return Type::Bool;
+    else if (type == "i")       return Type::Int;
+    else if (type == "I")       return Type::Impulse;
+    else if (type == "s")       return Type::String;
+    else if (type == "ff")      return Type::Vec2f;
+    else if (type == "fff")     return Type::Vec3f;
+    else if (type == "ffff")    return Type::Vec4f;
+    else if (type == "N")       return Type::Impulse;
+    else if (type == "S")       return Type::String;
+    else if (type == "c")       return Type::Char;
+    else if (type == "h")       return Type::Int64;
+    else if (type == "d")       return Type::Double;
+    else if (type == "t")       return Type::Timetag;
+    else if (type == "m")       return Type::Midi;
+    else if (type == "b")       return Type::Blob;
+    else if (type == "r")       return Type::Color;
+    else                        return Type::None;
 }
 
 void
@@ -136,19 +264,89 @@ WPN114::Network::Node::
 set_type(QMetaType::Type type)
 // sets node value type (QMetaType variant)
 {
-    m_type = static_cast<Type::Values>(type);
+    switch (type)
+    {
+    // the ones Type::Values doesn't share an id with
+    case QMetaType::UInt:       m_type = Type::Int; break;
+    case QMetaType::ULongLong:  m_type = Type::Int64; break;
+    case QMetaType::Float:      m_type = Type::Float; break;
+    default:                    m_type = static_cast<Type::Values>(type);
+    }
+
+    on_type_changed();
 }
 
 void
 WPN114::Network::Node::
 set_value(QVariant value)
 {
-    emit valueReceived(value);
+    set_value(Value::from_variant(value, m_type));
+}
+
+void
+WPN114::Network::Node::
+set_value(Value const& value)
+{
+    static const auto received = QMetaMethod::fromSignal(&Node::valueReceived);
+    static const auto changed  = QMetaMethod::fromSignal(&Node::valueChanged);
+
+    if (isSignalConnected(received))
+        emit valueReceived(value.to_variant());
+
+    if (m_stored) {
+        // typed comparison against the tree's value store
+        if (!m_tree->values().set_value(m_id, value))
+            return;
+    }
+    else if (value != m_value)
+         m_value = value;
+    else return;
+
+    invalidate_json(true);
+
+    if (m_observed && m_tree)
+        m_tree->notify(*this);
+
+    if (isSignalConnected(changed))
+        emit valueChanged(value.to_variant());
+}
+
+QVariant
+WPN114::Network::Node::
+value() const
+{
+    return typed_value().to_variant();
+}
 
-    if (value != m_value) {
-        emit valueChanged(value);
-        m_value = value;
+Value
+WPN114::Network::Node::
+typed_value() const
+{
+    if  (m_stored)
+         return m_tree->values().value(m_id);
+    else return m_value;
+}
+
+void
+WPN114::Network::Node::
+set_stored(bool stored)
+{
+    if (stored == m_stored || !m_tree)
+        return;
+
+    auto& values = m_tree->values();
+
+    if (stored) {
+        values.insert(m_id, m_type);
+        values.set_value(m_id, m_value);
+        m_value = Value();
+    }
+    else {
+        m_value = values.value(m_id);
+        values.remove(m_id);
     }
+
+    m_stored = stored;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -170,8 +368,10 @@ WPN114::Network::Node::
 create_subnode(QString name)
 // instantiates child node with name 'name' and type 'none'
 {
-    m_subnodes.push_back(new Node(*this, name, Type::None));
-    return m_subnodes.back();
+    auto subnode = m_tree ? m_tree->make_node(*this, name, Type::None) :
+                            new Node(*this, name, Type::None);
+    add_subnode(subnode);
+    return subnode;
 }
 
 void
@@ -179,8 +379,15 @@ WPN114::Network::Node::
 add_subnode(Node* subnode)
 // add subnode as child
 {
+    load_subnodes();
     subnode->set_parent_node(this);
     m_subnodes.push_back(subnode);
+    invalidate_json();
+
+    if (m_tree) {
+        m_tree->index(subnode);
+        m_tree->notify_added(*subnode);
+    }
 }
 
 void
@@ -192,6 +399,20 @@ remove_subnode(Node* subnode)
 {
     m_subnodes.removeOne(subnode);
     subnode->set_zombie(true);
+    invalidate_json();
+
+    if (m_tree) {
+        m_tree->unindex(subnode);
+        m_tree->notify_removed(*subnode);
+    }
+}
+
+void
+WPN114::Network::Node::
+load_subnodes() const
+{
+    if (!m_expanded && m_tree)
+        m_tree->load_subnodes(const_cast<Node*>(this));
 }
 
 Node*
@@ -199,17 +420,39 @@ WPN114::Network::Node::
 subnode(QString name)
 // retrieve subnode from name, returning nullptr if not found
 {
+    if (m_tree && m_id) {
+        // compare interned names rather than strings
+        auto atom = m_tree->find_atom(name);
+        return atom ? subnode_atom(atom) : nullptr;
+    }
+
+    load_subnodes();
+
     for (const auto& subnode : m_subnodes)
          if (subnode->name() == name)
              return subnode;
     return nullptr;
 }
 
+Node*
+WPN114::Network::Node::
+subnode_atom(uint32_t atom)
+{
+    load_subnodes();
+
+    for (const auto& subnode : m_subnodes)
+         if (subnode->atom() == atom)
+             return subnode;
+    return nullptr;
+}
+
 Node*
 WPN114::Network::Node::
 subnode(size_t index)
 // retrieve subnode from index, returning nullptr if out of bounds
 {
+    load_subnodes();
+
     if  (index < m_subnodes.count())
          return m_subnodes[index];
     else return nullptr;
@@ -263,6 +506,8 @@ WPN114::Network::Node::
 operator QJsonObject() const
 // get Node's current attribute values and contents recursively, JSON-formatted
 {
+    load_subnodes();
+
     QJsonObject contents;
     for (auto& subnode : m_subnodes)
          contents.insert(subnode->name(),
@@ -273,6 +518,75 @@ operator QJsonObject() const
     return attr;
 }
 
+QByteArray const&
+WPN114::Network::Node::
+json() const
+// a node is dirty whenever one of its subnodes is, so clean subtrees are copied as they are
+{
+    if (!m_json_dirty)
+        return m_json;
+
+    m_json.resize(0);
+    append_json_head(m_json);
+    m_json_head = m_json.size();
+
+    // mirrored subnodes that haven't been loaded are serialized from their records,
+    // publishing the namespace doesn't turn them into nodes
+    if (!m_expanded && m_tree)
+        m_tree->append_records_json(m_id, m_json);
+
+    for (int n = 0; n < m_subnodes.count(); ++n)
+    {
+        auto subnode = m_subnodes[n];
+        if (n) m_json.append(',');
+
+        append_json_string(m_json, subnode->name());
+        m_json.append(':');
+        m_json.append(subnode->json());
+    }
+
+    m_json.append("}}");
+    m_json_dirty = false;
+
+    return m_json;
+}
+
+void
+WPN114::Network::Node::
+append_json_head(QByteArray& out) const
+{
+    // attributes always hold at least FULL_PATH:
+    // drop the closing brace and append contents after it
+    auto attr = QJsonDocument(attributes()).toJson(QJsonDocument::Compact);
+
+    out.append(attr.constData(), attr.size()-1);
+    out.append(",\"").append(wpn_json_contents).append("\":{");
+}
+
+void
+WPN114::Network::Node::
+invalidate_json(bool value_only)
+{
+    // stop at the first ancestor that's already dirty, its own ancestors have to be as well
+    auto node = this;
+    for (; !node->m_json_dirty; node = node->m_parent_node) {
+         node->m_json_dirty = true;
+         if (!node->m_parent_node)
+             break;
+    }
+
+    if (!m_tree)
+        return;
+
+    // reaching the root means the namespace has changed since it was last published.
+    // the root may already be dirty from a value change only, whose publish is deferred:
+    // anything else still has to go out on this turn
+    if  (node == m_tree->root())
+         m_tree->schedule_publish(value_only);
+    else if (!value_only)
+         m_tree->schedule_publish();
+}
+
 void
 WPN114::Network::Node::
 update(QJsonObject object)
@@ -287,16 +601,31 @@ update(QJsonObject object)
     if (object.contains(wpn_json_contents))
     {
         // recursively parse and build children nodes
+        // detached nodes (being built from json themselves) allocate from their parent's pool
         auto contents = object[wpn_json_contents].toObject();
+        auto pool = m_tree ? m_tree : m_allocator;
+
         for (const auto& key : contents.keys()) {
-            auto node = new Node(contents[key].toObject());
+            auto node = pool ? pool->make_node() : new Node;
+            node->update(contents[key].toObject());
             node->set_name(key);
             add_subnode(node);
         }
     }
 
     if (object.contains(wpn_json_value))
-        set_value(object[wpn_json_value].toVariant());
+        set_value(value_from_json(m_type, object[wpn_json_value]));
+}
+
+QVariant
+WPN114::Network::Node::
+value_from_json(Type::Values type, QJsonValue const& value)
+{
+    if (type == Type::Blob)
+         return QByteArray::fromBase64(value.toString().toLatin1());
+    else if (type == Type::Color)
+         return QColor(value.toString());
+    else return value.toVariant();
 }
 
 void
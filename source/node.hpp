@@ -10,37 +10,13 @@
 #include <QJsonArray>
 #include <QDir>
 
+#include "value.hpp"
+
 namespace WPN114   {
 namespace Network  {
 
 class Tree;
 
-//=================================================================================================
-class Type : public QObject
-//=================================================================================================
-{
-    Q_OBJECT
-
-public:
-    enum Values
-    {
-        None        = 43,
-        Bool        = 1,
-        Int         = 2,
-        Float       = 6,
-        String      = 10,
-        List        = 9,
-        Vec2f       = 82,
-        Vec3f       = 83,
-        Vec4f       = 84,
-        Char        = 34,
-        Impulse     = 0,
-        File        = 11
-    };
-
-    Q_ENUM (Values)
-};
-
 //=================================================================================================
 class Node : public QObject, public QQmlParserStatus, public QQmlPropertyValueSource
 //=================================================================================================
@@ -86,6 +62,19 @@ public:
     virtual
     ~Node() override;
 
+    static void
+    operator delete(void* node);
+    // nodes allocated from a tree's pool go back to it, whoever deletes them (qml, qt parenting),
+    // everything else (new, qml's own allocations) is freed as usual
+
+    //---------------------------------------------------------------------------------------------
+    void
+    set_allocator(Tree* tree) { m_allocator = tree; }
+
+    Tree*
+    allocator() const { return m_allocator; }
+    // the tree whose node pool holds this node, nullptr if it was allocated with 'new'
+
     //---------------------------------------------------------------------------------------------
     virtual void
     classBegin() override {}
@@ -118,7 +107,11 @@ public:
 
     //---------------------------------------------------------------------------------------------
     QVariant
-    value() const { return m_value; }
+    value() const;
+    // qml/json side, see typed_value() for everything else
+
+    Value
+    typed_value() const;
 
     bool
     critical() const { return m_critical; }
@@ -129,6 +122,18 @@ public:
     QString
     path() const { return m_path; }
 
+    QByteArray const&
+    address() const { return m_address; }
+    // utf8 path, as it appears on the wire
+
+    uint32_t
+    id() const { return m_id; }
+    // stable tree-wide identifier, 0 until the node is part of a tree
+
+    uint32_t
+    atom() const { return m_atom; }
+    // interned name
+
     Type::Values
     type() const { return m_type; }
 
@@ -138,8 +143,11 @@ public:
     Tree*
     tree() { return m_tree; }
 
+    Tree const*
+    tree() const { return m_tree; }
+
     int
-    nsubnodes() const { return m_subnodes.count(); }
+    nsubnodes() const { load_subnodes(); return m_subnodes.count(); }
 
     bool
     zombie() const { return m_zombie; }
@@ -158,31 +166,39 @@ public:
 
     //---------------------------------------------------------------------------------------------
     QString
-    typetag() const;
+    typetag() const { return typetag(m_type); }
+
+    static QString
+    typetag(Type::Values type);
 
     //---------------------------------------------------------------------------------------------
     QJsonValue
-    value_json() const;
+    value_json() const { return value_json(m_type, typed_value()); }
+
+    static QJsonValue
+    value_json(Type::Values type, Value const& value);
+    // also used for mirrored records, which don't have a node yet
 
     //---------------------------------------------------------------------------------------------
     void
     set_value(QVariant value);
+    // converted to the node's type
 
-    //---------------------------------------------------------------------------------------------
     void
-    set_name(QString name)
+    set_value(Value const& value);
+    // signals carrying a QVariant are only emitted if something is connected to them
+
     //---------------------------------------------------------------------------------------------
-    {
-        m_name = name;
-    }
+    void
+    set_name(QString name);
 
     //---------------------------------------------------------------------------------------------
     void
-    set_path(QString path)
+    set_id(uint32_t id, uint32_t atom);
+
     //---------------------------------------------------------------------------------------------
-    {
-        m_path = path;
-    }
+    void
+    set_path(QString path);
 
     //-------------------------------------------------------------------------------------------------
     void
@@ -205,11 +221,12 @@ public:
     //---------------------------------------------------------------------------------------------
     {
         m_critical = critical;
+        invalidate_json();
     }
 
     //---------------------------------------------------------------------------------------------
     void
-    set_type(Type::Values type) { m_type = type; }
+    set_type(Type::Values type);
 
     void
     set_type(QString const type);
@@ -217,9 +234,46 @@ public:
     void
     set_type(QMetaType::Type type);
 
+    void
+    on_type_changed();
+
+    static Type::Values
+    type_from_tag(QString const& tag);
+
+    static QVariant
+    value_from_json(Type::Values type, QJsonValue const& value);
+
     //---------------------------------------------------------------------------------------------
     QVector<Node*>&
-    subnodes() { return m_subnodes; }
+    subnodes() { load_subnodes(); return m_subnodes; }
+
+    QVector<Node*> const&
+    loaded_subnodes() const { return m_subnodes; }
+    // without loading mirrored subnodes that are still held as records by the tree
+
+    bool
+    stored() const { return m_stored; }
+
+    bool
+    observed() const { return m_observed; }
+
+    void
+    set_observed(bool observed) { m_observed = observed; }
+    // observed nodes notify their tree's observer when their value changes
+
+    void
+    set_stored(bool stored);
+    // moves value in or out of the tree's value store
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    expanded() const { return m_expanded; }
+
+    void
+    set_expanded(bool expanded) { m_expanded = expanded; }
+
+    void
+    load_subnodes() const;
 
     Node*
     create_subnode(QString name);
@@ -233,6 +287,9 @@ public:
     Node*
     subnode(QString name);
 
+    Node*
+    subnode_atom(uint32_t atom);
+
     Node*
     subnode(size_t index);
 
@@ -243,6 +300,25 @@ public:
     operator
     QJsonObject() const;
 
+    QByteArray const&
+    json() const;
+    // same as above, serialized: cached per node and only rebuilt for branches that changed
+
+    bool
+    json_cached() const { return !m_json_dirty; }
+
+    int
+    json_head() const { return m_json_head; }
+    // size of the cached json's attributes and CONTENTS opening
+
+    void
+    append_json_head(QByteArray& out) const;
+    // appends attributes and opens CONTENTS, leaving two braces to be closed
+
+    void
+    invalidate_json(bool value_only = false);
+    // marks this node's cached json as stale, along with its ancestors'
+
     void
     update(QJsonObject object);
 
@@ -265,11 +341,11 @@ public:
     // appends a subnode to this Node children
 
     Q_INVOKABLE int
-    nsubnodes() { return m_subnodes.count(); }
+    nsubnodes() { load_subnodes(); return m_subnodes.count(); }
     // returns this Node' subnodes count
 
     Q_INVOKABLE Node*
-    subnode(int index) { return m_subnodes.at(index); }
+    subnode(int index) { load_subnodes(); return m_subnodes.at(index); }
     // returns this Node' subnode at index
 
     Q_INVOKABLE void
@@ -314,24 +390,45 @@ protected:
     m_path,
     m_extended_type;
 
+    QByteArray
+    m_address;
+
+    uint32_t
+    m_id = 0,
+    m_atom = 0;
+
     Type::Values
     m_type = Type::None;
 
-    QVariant
+    Value
     m_value;
 
     Node*
     m_parent_node = nullptr;
 
     Tree*
-    m_tree = nullptr;
+    m_tree = nullptr,
+    *m_allocator = nullptr;
 
     QVector<Node*>
     m_subnodes;
 
+    mutable QByteArray
+    m_json;
+
+    mutable int
+    m_json_head = 0;
+
     bool
     m_critical = false,
-    m_zombie = false;
+    m_zombie = false,
+    m_stored = false,
+    m_observed = false,
+    m_expanded = true;
+    // false while the tree keeps this node's subnodes as records
+
+    mutable bool
+    m_json_dirty = true;
 
     QQmlProperty
     m_target;
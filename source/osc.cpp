@@ -1,181 +1,880 @@
 #include "osc.hpp"
+#include "osc_typed.hpp"
+#include "endian.hpp"
+#include <QtEndian>
+#include <QJSValue>
+#include <QDateTime>
+#include <QColor>
+#include <cstring>
+#include <algorithm>
 
 using namespace WPN114::Network;
 
-template<typename _Valuetype> void
-deserialize(QVariantList& arglst, QDataStream& stream)
+static inline size_t
+pad4(size_t size) { return (size+3) & ~size_t(3); }
+
+static inline size_t
+padded_string_size(const char* data, size_t remaining)
+// padded size of a null-terminated OSC string, 0 if no terminator within bounds
 {
-    _Valuetype target_value;
-    stream >> target_value;
-    arglst << target_value;
+    auto end = static_cast<const char*>(memchr(data, 0, remaining));
+    if (end == nullptr)
+        return 0;
+
+    auto size = pad4(end-data+1);
+    return size <= remaining ? size : 0;
 }
 
-template<> void
-deserialize<QString>(QVariantList& arglist, QDataStream& stream)
+int64_t
+WPN114::Network::OSCArgument::
+size(char tag, const char* data, size_t remaining)
 {
-    uint8_t byte;
-    QByteArray data;
+    size_t size = 0;
 
-    stream >> byte;
-    while (byte) { data.append(byte); stream >> byte; }
+    switch (tag)
+    {
+    case 'i':
+    case 'f':
+    case 'c':
+    case 'r':
+    case 'm':
+        size = 4;
+        break;
+    case 'h':
+    case 'd':
+    case 't':
+        size = 8;
+        break;
+    case 's':
+    case 'S':
+        if ((size = padded_string_size(data, remaining)) == 0)
+            return -1;
+        break;
+    case 'b':
+    {
+        if (remaining < 4)
+            return -1;
+        auto blsz = qFromBigEndian<qint32>(data);
+        if (blsz < 0)
+            return -1;
+        size = 4+pad4(blsz);
+        break;
+    }
+    case 'T':
+    case 'F':
+    case 'N':
+    case 'I':
+    case '[':
+    case ']':
+        return 0;
+    default:
+        // unknown tag: we can't know how far to skip
+        return -1;
+    }
 
-    uint8_t padding = 4-(data.count()%4);
-    stream.skipRawData(padding-1);
-    arglist << QString::fromUtf8(data);
+    return size <= remaining ? size : -1;
 }
 
-WPN114::Network::OSCMessage::
-OSCMessage(QByteArray const& data)
+int32_t
+WPN114::Network::OSCArgument::
+to_int() const
 {
-    QDataStream stream(data);
-    QVariantList arguments;
-    QString typetag;
+    return qFromBigEndian<qint32>(m_data);
+}
 
-    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
-    stream.setByteOrder(QDataStream::BigEndian);
+int64_t
+WPN114::Network::OSCArgument::
+to_int64() const
+{
+    return qFromBigEndian<qint64>(m_data);
+}
 
-    auto comsep = data.split(',');
-    m_method = comsep[0];
-    typetag  = comsep[1].split('\0')[0];
+float
+WPN114::Network::OSCArgument::
+to_float() const
+{
+    float value;
+    auto bits = qFromBigEndian<quint32>(m_data);
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
 
-    uint8_t adpads = 4-(m_method.count()%4);
-    uint8_t ttpads = 4-((typetag.count()+1)%4);
-    uint32_t total = m_method.count()+adpads+typetag.count()+1+ttpads;
+double
+WPN114::Network::OSCArgument::
+to_double() const
+{
+    double value;
+    auto bits = qFromBigEndian<quint64>(m_data);
+    memcpy(&value, &bits, sizeof(double));
+    return value;
+}
 
-    stream.skipRawData(total);
+std::string_view
+WPN114::Network::OSCArgument::
+to_blob() const
+{
+    return std::string_view(m_data+4, qFromBigEndian<qint32>(m_data));
+}
 
-    for (const auto& c : typetag)
+QVariant
+WPN114::Network::OSCArgument::
+to_variant() const
+{
+    switch (m_tag)
     {
-        switch (c.toLatin1())
-        {
-        case 'i':
-             deserialize<int>(arguments, stream);
-             break;
+    case 'i': return to_int();
+    case 'f': return to_float();
+    case 'h': return static_cast<qlonglong>(to_int64());
+    case 'd': return to_double();
+    case 't': return static_cast<qulonglong>(to_timetag());
+    case 'm': return static_cast<quint32>(to_int());
+    case 'c': return QChar(to_int());
+    case 's':
+    case 'S': return QString::fromUtf8(m_data);
+    case 'T': return true;
+    case 'F': return false;
+    case 'r':
+    {
+        auto rgba = reinterpret_cast<const uint8_t*>(m_data);
+        return QColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+    }
+    case 'b':
+    {
+        auto blob = to_blob();
+        return QByteArray(blob.data(), blob.size());
+    }
+    default:  return QVariant();
+    }
+}
 
-        case 'f':
-             deserialize<float>(arguments, stream);
-             break;
+WPN114::Network::OSCView::
+OSCView(const char* data, size_t size) :
+    m_data(data), m_size(size)
+{
+    // address, padded to 4 bytes
+    if (size < 4 || data[0] != '/')
+        return;
+
+    m_end = data+size;
+
+    auto adsz = padded_string_size(data, size);
+    if (adsz == 0)
+        return;
+
+    m_address = std::string_view(data, strlen(data));
+
+    // typetag, padded to 4 bytes
+    // a message without typetag is tolerated and treated as argument-less
+    auto tt = data+adsz;
+    auto remaining = size-adsz;
+
+    if (remaining == 0) {
+        m_arguments = tt;
+        m_valid = true;
+        return;
+    }
+
+    if (tt[0] != ',')
+        return;
+
+    auto ttsz = padded_string_size(tt, remaining);
+    if (ttsz == 0)
+        return;
+
+    m_typetag = std::string_view(tt+1, strlen(tt+1));
+    m_arguments = tt+ttsz;
+    remaining -= ttsz;
+
+    // check that every argument fits in the packet and that arrays are balanced
+    auto argument = m_arguments;
+    int depth = 0;
+
+    for (const auto& tag : m_typetag)
+    {
+        auto argsz = OSCArgument::size(tag, argument, remaining);
+        if (argsz < 0)
+            return;
+
+        if (tag == '[')
+            depth++;
+        else if (tag == ']' && --depth < 0)
+            return;
+
+        argument  += argsz;
+        remaining -= argsz;
+    }
+
+    m_valid = depth == 0;
+}
+
+template<typename _Valuetype> static size_t
+read_run(std::string_view typetag, const char* data, char tag, _Valuetype* dst, size_t max)
+{
+    size_t count = 0;
+
+    while (count < max && count < typetag.size() && typetag[count] == tag)
+           count++;
+
+    bswap32_copy(dst, data, count);
+    return count;
+}
+
+size_t
+WPN114::Network::OSCView::
+read(float* dst, size_t max) const
+{
+    return read_run(m_typetag, m_arguments, 'f', dst, max);
+}
+
+size_t
+WPN114::Network::OSCView::
+read(int32_t* dst, size_t max) const
+{
+    return read_run(m_typetag, m_arguments, 'i', dst, max);
+}
 
-        case 's':
-             deserialize<QString>(arguments, stream);
-             break;
+static QVariantList
+to_list(OSCView::const_iterator& argument, OSCView::const_iterator const& end)
+// reads arguments until the end of the current array
+{
+    QVariantList list;
 
-        case 'T':
-             arguments << true;
-             break;
+    while (argument != end)
+    {
+        auto current = *argument;
+        ++argument;
 
-        case 'F':
-             arguments << false;
+        if (current.tag() == ']')
             break;
-        }
+        else if (current.tag() == '[')
+             list << QVariant(to_list(argument, end));
+        else list << current.to_variant();
     }
 
-    switch (arguments.count())
+    return list;
+}
+
+QVariant
+WPN114::Network::OSCView::
+arguments() const
+{
+    if (m_typetag.find('[') == std::string_view::npos)
     {
+        // flat argument list
+        switch (count())
+        {
         case 0:
-             break;
+             return QVariant();
         case 1:
-             m_arguments = arguments[0];
-             break;
+             return (*begin()).to_variant();
         default:
-             m_arguments = arguments;
+        {
+            QVariantList arguments;
+            arguments.reserve(count());
+
+            auto data = m_arguments;
+            size_t n = 0;
+
+            while (n < count())
+            {
+                auto tag = m_typetag[n];
+
+                if (tag == 'f' || tag == 'i') {
+                    // contiguous 'f'/'i' runs are byte-swapped in bulk
+                    uint32_t run[64];
+                    size_t length = 1;
+
+                    while (n+length < count() && length < 64 && m_typetag[n+length] == tag)
+                           length++;
+
+                    bswap32_copy(run, data, length);
+
+                    for (size_t r = 0; r < length; ++r) {
+                        if (tag == 'i')
+                            arguments << static_cast<int32_t>(run[r]);
+                        else {
+                            float value;
+                            memcpy(&value, &run[r], sizeof(float));
+                            arguments << value;
+                        }
+                    }
+
+                    data += length*4;
+                    n += length;
+                    continue;
+                }
+
+                arguments << OSCArgument(tag, data).to_variant();
+                data += OSCArgument::size(tag, data, m_end-data);
+                n++;
+            }
+
+            return arguments;
+        }
+        }
     }
+
+    auto argument = begin();
+    auto arguments = to_list(argument, end());
+
+    if (arguments.count() == 1)
+         return arguments[0];
+    else return arguments;
 }
 
-QByteArray
-WPN114::Network::OSCMessage::
-encode() const
+//-------------------------------------------------------------------------------------------------
+// ENCODER
+//-------------------------------------------------------------------------------------------------
+
+static size_t
+utf8_size(QString const& string)
 {
-    QByteArray data;
-    QString tt = typetag(m_arguments).prepend(',');
-    data.append(m_method);
+    size_t size = 0;
+    auto data = string.constData();
+    auto end  = data+string.size();
+
+    for (; data < end; ++data) {
+        auto c = data->unicode();
+        if (c < 0x80)
+            size += 1;
+        else if (c < 0x800)
+            size += 2;
+        else if (data->isHighSurrogate() && data+1 < end && (data+1)->isLowSurrogate()) {
+            size += 4;
+            ++data;
+        }
+        else size += 3;
+    }
 
-    auto pads = 4-(m_method.count()%4);
-    while (pads--) data.append((char)0);
+    return size;
+}
 
-    data.append(tt);
-    pads = 4-(tt.count()%4);
+static char*
+utf8_write(char* dst, QString const& string)
+// writes 'string' as utf8 without going through a temporary QByteArray
+{
+    auto data = string.constData();
+    auto end  = data+string.size();
 
-    while (pads--) data.append((char)0);
-    append(data, m_arguments);
+    for (; data < end; ++data)
+    {
+        uint c = data->unicode();
 
-    return data;
+        if (c < 0x80)
+            *dst++ = c;
+        else if (c < 0x800) {
+            *dst++ = 0xc0 | (c >> 6);
+            *dst++ = 0x80 | (c & 0x3f);
+        }
+        else if (data->isHighSurrogate() && data+1 < end && (data+1)->isLowSurrogate()) {
+            c = QChar::surrogateToUcs4(data[0], data[1]);
+            *dst++ = 0xf0 | (c >> 18);
+            *dst++ = 0x80 | ((c >> 12) & 0x3f);
+            *dst++ = 0x80 | ((c >> 6) & 0x3f);
+            *dst++ = 0x80 | (c & 0x3f);
+            ++data;
+        }
+        else {
+            *dst++ = 0xe0 | (c >> 12);
+            *dst++ = 0x80 | ((c >> 6) & 0x3f);
+            *dst++ = 0x80 | (c & 0x3f);
+        }
+    }
+
+    return dst;
 }
 
-QString
-WPN114::Network::OSCMessage::
-typetag(QVariant const& argument) const
+static inline void
+write_float(char*& data, float value)
+{
+    quint32 bits;
+    memcpy(&bits, &value, sizeof(float));
+    qToBigEndian<quint32>(bits, data);
+    data += 4;
+}
+
+static inline void
+write_floats(char*& data, const float* values, size_t count)
 {
-    switch (argument.type())
+    bswap32_copy(data, values, count);
+    data += count*4;
+}
+
+static inline bool
+is_single_float(QVariant const& argument, int flags)
+{
+    return argument.userType() == QMetaType::Float ||
+          (argument.userType() == QMetaType::Double && !(flags & OSCEncoder::DoublePrecision));
+}
+
+static inline void
+write_double(char*& data, double value)
+{
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(double));
+    qToBigEndian<quint64>(bits, data);
+    data += 8;
+}
+
+static inline void
+write_string(char*& data, QString const& string)
+{
+    auto end = utf8_write(data, string);
+    auto padded = data+pad4(end-data+1);
+    while (end < padded) *end++ = 0;
+    data = padded;
+}
+
+void
+WPN114::Network::OSCEncoder::
+measure(QVariant const& argument, size_t& ntags, size_t& nbytes, int flags, int depth)
+{
+    switch (argument.userType())
     {
-    case QVariant::Bool:
-        return argument.value<bool>() ? "T" : "F";
+    case QMetaType::Bool:
+        ntags += 1;
+        return;
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Float:
+    case QMetaType::QChar:
+    case QMetaType::Char:
+    case QMetaType::QColor:
+        ntags  += 1;
+        nbytes += 4;
+        return;
+    case QMetaType::Double:
+        ntags  += 1;
+        nbytes += flags & DoublePrecision ? 8 : 4;
+        return;
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        ntags  += 1;
+        nbytes += 8;
+        return;
+    case QMetaType::QString:
+        ntags  += 1;
+        nbytes += pad4(utf8_size(argument.toString())+1);
+        return;
+    case QMetaType::QByteArray:
+        ntags  += 1;
+        nbytes += 4+pad4(static_cast<const QByteArray*>(argument.constData())->size());
+        return;
+    case QMetaType::QVector2D:
+        ntags  += 2;
+        nbytes += 8;
+        return;
+    case QMetaType::QVector3D:
+        ntags  += 3;
+        nbytes += 12;
+        return;
+    case QMetaType::QVector4D:
+        ntags  += 4;
+        nbytes += 16;
+        return;
+    case QMetaType::QStringList:
+        if (depth) ntags += 2; // '[' and ']'
+        for (const auto& sub : *static_cast<const QStringList*>(argument.constData())) {
+             ntags  += 1;
+             nbytes += pad4(utf8_size(sub)+1);
+        }
+        return;
+    case QMetaType::QVariantList:
+        if (depth) ntags += 2;
+        for (const auto& sub : *static_cast<const QVariantList*>(argument.constData()))
+             measure(sub, ntags, nbytes, flags, depth+1);
+        return;
+    }
 
-    case QVariant::Int:         return "i";
-    case QVariant::Double:      return "f";
-    case QVariant::String:      return "s";
-    case QVariant::Vector2D:    return "ff";
-    case QVariant::Vector3D:    return "fff";
-    case QVariant::Vector4D:    return "ffff";
+    if (argument.userType() == qMetaTypeId<QJSValue>()) {
+        if (depth) ntags += 2;
+        for (const auto& sub : argument.toList())
+             measure(sub, ntags, nbytes, flags, depth+1);
+        return;
     }
 
-    if (argument.type() == QVariant::List ||
-        strcmp(argument.typeName(), "QJSValue") == 0)
+    ntags += 1; // 'N'
+}
+
+void
+WPN114::Network::OSCEncoder::
+write(QVariant const& argument, char*& tag, char*& data, int flags, int depth)
+{
+    switch (argument.userType())
+    {
+    case QMetaType::Bool:
+        *tag++ = argument.toBool() ? 'T' : 'F';
+        return;
+    case QMetaType::Int:
+        *tag++ = 'i';
+        qToBigEndian<qint32>(argument.toInt(), data);
+        data += 4;
+        return;
+    case QMetaType::UInt:
+        *tag++ = 'm';
+        qToBigEndian<quint32>(argument.toUInt(), data);
+        data += 4;
+        return;
+    case QMetaType::QChar:
+    case QMetaType::Char:
+        *tag++ = 'c';
+        qToBigEndian<qint32>(argument.toChar().unicode(), data);
+        data += 4;
+        return;
+    case QMetaType::QColor:
+    {
+        auto color = argument.value<QColor>();
+        *tag++ = 'r';
+        *data++ = color.red();
+        *data++ = color.green();
+        *data++ = color.blue();
+        *data++ = color.alpha();
+        return;
+    }
+    case QMetaType::Float:
+        *tag++ = 'f';
+        write_float(data, argument.toFloat());
+        return;
+    case QMetaType::Double:
+        if (flags & DoublePrecision) {
+            *tag++ = 'd';
+            write_double(data, argument.toDouble());
+        } else {
+            *tag++ = 'f';
+            write_float(data, argument.toFloat());
+        }
+        return;
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        *tag++ = argument.userType() == QMetaType::LongLong ? 'h' : 't';
+        qToBigEndian<quint64>(argument.toULongLong(), data);
+        data += 8;
+        return;
+    case QMetaType::QString:
+        *tag++ = 's';
+        write_string(data, argument.toString());
+        return;
+    case QMetaType::QByteArray:
+    {
+        auto blob = static_cast<const QByteArray*>(argument.constData());
+        *tag++ = 'b';
+        qToBigEndian<qint32>(blob->size(), data);
+        memcpy(data+4, blob->constData(), blob->size());
+        auto end = data+4+blob->size();
+        data += 4+pad4(blob->size());
+        while (end < data) *end++ = 0;
+        return;
+    }
+    case QMetaType::QVector2D:
+    {
+        auto v = argument.value<QVector2D>();
+        float values[2] = { v.x(), v.y() };
+        memset(tag, 'f', 2); tag += 2;
+        write_floats(data, values, 2);
+        return;
+    }
+    case QMetaType::QVector3D:
+    {
+        auto v = argument.value<QVector3D>();
+        float values[3] = { v.x(), v.y(), v.z() };
+        memset(tag, 'f', 3); tag += 3;
+        write_floats(data, values, 3);
+        return;
+    }
+    case QMetaType::QVector4D:
     {
-        // if argument is QVariantList or QJSValue
-        // recursively parse arguments
-        QString tag;
-        for (const auto& sub: argument.toList())
-            tag.append(OSCMessage::typetag(sub));
-        return tag;
+        auto v = argument.value<QVector4D>();
+        float values[4] = { v.x(), v.y(), v.z(), v.w() };
+        memset(tag, 'f', 4); tag += 4;
+        write_floats(data, values, 4);
+        return;
     }
+    case QMetaType::QStringList:
+        if (depth) *tag++ = '[';
+        for (const auto& sub : *static_cast<const QStringList*>(argument.constData())) {
+             *tag++ = 's';
+             write_string(data, sub);
+        }
+        if (depth) *tag++ = ']';
+        return;
+    case QMetaType::QVariantList:
+    {
+        // top-level lists are the argument list itself, nested ones are encoded as arrays
+        auto& list = *static_cast<const QVariantList*>(argument.constData());
+        if (depth) *tag++ = '[';
+
+        for (int n = 0; n < list.count();)
+        {
+            // gather contiguous float runs and byte-swap them in bulk
+            float run[64];
+            int length = 0;
+
+            while (n < list.count() && length < 64 && is_single_float(list[n], flags))
+                   run[length++] = list[n++].toFloat();
+
+            if (length) {
+                memset(tag, 'f', length); tag += length;
+                write_floats(data, run, length);
+            }
+            else write(list[n++], tag, data, flags, depth+1);
+        }
 
-    return "N";
+        if (depth) *tag++ = ']';
+        return;
+    }
+    }
+
+    if (argument.userType() == qMetaTypeId<QJSValue>()) {
+        if (depth) *tag++ = '[';
+        for (const auto& sub : argument.toList())
+             write(sub, tag, data, flags, depth+1);
+        if (depth) *tag++ = ']';
+        return;
+    }
+
+    *tag++ = 'N';
 }
 
 void
-WPN114::Network::OSCMessage::
-append(QByteArray& data, QVariant const& argument) const
-{
-    QDataStream stream(&data, QIODevice::ReadWrite);
-
-    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
-    stream.skipRawData(data.size());
-
-    switch(argument.type())
-    {
-    case QVariant::Bool:
-         stream << argument.value<bool>();
-         break;
-    case QVariant::Int:
-          stream << argument.value<int>();
-          break;
-    case QVariant::Double:
-          stream << argument.value<float>();
-          break;
-    case QVariant::Vector2D:
-         stream << argument.value<QVector2D>();
-         break;
-    case QVariant::Vector3D:
-         stream << argument.value<QVector3D>();
-         break;
-    case QVariant::Vector4D:
-         stream << argument.value<QVector4D>();
-         break;
-
-    case QVariant::String:
-    {
-        QByteArray str = argument.toString().toUtf8();
-        auto pads = 4-(str.count()%4);
-        while (pads--) str.append('\0');
-        data.append(str);
-        break;
+WPN114::Network::OSCEncoder::
+append(QByteArray& buffer, QString const& address, QVariant const& arguments, int flags)
+{
+    size_t ntags = 0, nbytes = 0;
+    measure(arguments, ntags, nbytes, flags, 0);
+
+    auto adsz   = pad4(utf8_size(address)+1);
+    auto ttsz   = pad4(ntags+2);
+    auto offset = buffer.size();
+
+    // grow once, this doesn't reallocate as long as the buffer has enough capacity reserved
+    buffer.resize(offset+adsz+ttsz+nbytes);
+
+    auto packet = buffer.data()+offset;
+    memset(packet, 0, adsz+ttsz);
+    utf8_write(packet, address);
+
+    auto tag  = packet+adsz;
+    auto data = tag+ttsz;
+    *tag++ = ',';
+
+    write(arguments, tag, data, flags, 0);
+}
+
+void
+WPN114::Network::OSCEncoder::
+append(QByteArray& buffer, std::string_view address, Value const& value, int flags)
+{
+    if (!value.typed()) {
+        append(buffer, QString::fromUtf8(address.data(), address.size()), value.variant(), flags);
+        return;
     }
-    case QVariant::List:
+
+    using XY = OSCTypedMessage<float, float>;
+    using XYZ = OSCTypedMessage<float, float, float>;
+    using XYZW = OSCTypedMessage<float, float, float, float>;
+
+    auto vec = value.vec();
+
+    // fixed signatures, the bulk of node updates: typetag and size are known at compile time
+    switch (value.type())
     {
-        for (const auto& sub : argument.value<QVariantList>())
-             OSCMessage::append(data, sub);
+    case Type::Int:     return OSCTypedMessage<int32_t>::append(buffer, address, value.to_int());
+    case Type::Float:   return OSCTypedMessage<float>::append(buffer, address, value.to_float());
+    case Type::Int64:   return OSCTypedMessage<int64_t>::append(buffer, address, value.to_int64());
+    case Type::Double:  return OSCTypedMessage<double>::append(buffer, address, value.to_double());
+    case Type::Vec2f:   return XY::append(buffer, address, vec[0], vec[1]);
+    case Type::Vec3f:   return XYZ::append(buffer, address, vec[0], vec[1], vec[2]);
+    case Type::Vec4f:   return XYZW::append(buffer, address, vec[0], vec[1], vec[2], vec[3]);
+    default:            break;
     }
+
+    char tag = 0;
+    size_t nbytes = 0;
+
+    switch (value.type())
+    {
+    case Type::Bool:    tag = value.to_bool() ? 'T' : 'F';  break;
+    case Type::Midi:    tag = 'm'; nbytes = 4;              break;
+    case Type::Char:    tag = 'c'; nbytes = 4;              break;
+    case Type::Timetag: tag = 't'; nbytes = 8;              break;
+    case Type::String:  tag = 's'; nbytes = pad4(value.bytes().size()+1); break;
+    case Type::Blob:    tag = 'b'; nbytes = 4+pad4(value.bytes().size()); break;
+    default:            return;
+    }
+
+    auto adsz   = pad4(address.size()+1);
+    auto ttsz   = pad4(3);
+    auto offset = buffer.size();
+
+    buffer.resize(offset+adsz+ttsz+nbytes);
+
+    // zeroed as a whole: covers address, typetag and string padding
+    auto packet = buffer.data()+offset;
+    memset(packet, 0, adsz+ttsz+nbytes);
+    memcpy(packet, address.data(), address.size());
+
+    auto data = packet+adsz+ttsz;
+    packet[adsz] = ',';
+    packet[adsz+1] = tag;
+
+    switch (value.type())
+    {
+    case Type::Midi:
+    case Type::Char:    qToBigEndian<qint32>(value.to_int(), data); break;
+    case Type::Timetag: qToBigEndian<qint64>(value.to_int64(), data); break;
+    case Type::String:  memcpy(data, value.bytes().constData(), value.bytes().size()); break;
+    case Type::Blob:
+        qToBigEndian<qint32>(value.bytes().size(), data);
+        memcpy(data+4, value.bytes().constData(), value.bytes().size());
+        break;
+    default:            break;
+    }
+}
+
+QByteArray&
+WPN114::Network::OSCEncoder::
+local_buffer()
+{
+    thread_local QByteArray buffer;
+
+    if (buffer.capacity() < 1024)
+        buffer.reserve(1024);
+
+    return buffer;
+}
+
+QString
+WPN114::Network::OSCEncoder::
+typetag(QVariant const& argument)
+{
+    size_t ntags = 0, nbytes = 0;
+    measure(argument, ntags, nbytes, 0, 0);
+
+    QByteArray tags(ntags, 0), data(nbytes, 0);
+    auto tag = tags.data();
+    auto dat = data.data();
+    write(argument, tag, dat, 0, 0);
+
+    return QString::fromLatin1(tags);
+}
+
+//-------------------------------------------------------------------------------------------------
+// BUNDLES
+//-------------------------------------------------------------------------------------------------
+
+// seconds between 1900 (ntp) and 1970 (unix) epochs
+static constexpr uint64_t
+ntp_epoch_offset = 2208988800u;
+
+uint64_t
+WPN114::Network::OSCTimetag::
+from_msecs(int64_t msecs)
+{
+    uint64_t secs = msecs/1000 + ntp_epoch_offset;
+    uint64_t frac = (uint64_t(msecs%1000) << 32)/1000;
+    return (secs << 32) | frac;
+}
+
+int64_t
+WPN114::Network::OSCTimetag::
+to_msecs(uint64_t timetag)
+{
+    int64_t secs = int64_t(timetag >> 32) - ntp_epoch_offset;
+    int64_t frac = ((timetag & 0xffffffff)*1000) >> 32;
+    return secs*1000 + frac;
+}
+
+uint64_t
+WPN114::Network::OSCTimetag::
+now()
+{
+    return from_msecs(QDateTime::currentMSecsSinceEpoch());
+}
+
+int64_t
+WPN114::Network::OSCTimetag::
+delay(uint64_t timetag)
+{
+    if (timetag == immediate)
+        return 0;
+
+    auto delay = to_msecs(timetag) - QDateTime::currentMSecsSinceEpoch();
+    return delay > 0 ? delay : 0;
+}
+
+void
+WPN114::Network::OSCBundleWriter::
+begin(uint64_t timetag)
+{
+    assert(m_depth < OSCPacket::max_depth);
+    auto offset = m_buffer.size();
+
+    if (m_depth == 0) {
+        m_buffer.resize(offset+16);
+    } else {
+        // nested bundle: reserve its size prefix
+        m_buffer.resize(offset+20);
+        offset += 4;
     }
+
+    auto header = m_buffer.data()+offset;
+    memcpy(header, "#bundle", 8);
+    qToBigEndian<quint64>(timetag, header+8);
+
+    m_offsets[m_depth++] = offset;
 }
 
+void
+WPN114::Network::OSCBundleWriter::
+end()
+{
+    if (m_depth <= 1)
+        return;
+
+    auto offset = m_offsets[--m_depth];
+    qToBigEndian<qint32>(m_buffer.size()-offset, m_buffer.data()+offset-4);
+}
+
+void
+WPN114::Network::OSCBundleWriter::
+append(QString const& address, QVariant const& arguments)
+{
+    auto offset = m_buffer.size();
+    m_buffer.resize(offset+4);
+
+    OSCEncoder::append(m_buffer, address, arguments);
+    qToBigEndian<qint32>(m_buffer.size()-offset-4, m_buffer.data()+offset);
+    m_count++;
+}
+
+void
+WPN114::Network::OSCBundleWriter::
+append(std::string_view address, Value const& value, int flags)
+{
+    auto offset = m_buffer.size();
+    m_buffer.resize(offset+4);
+
+    OSCEncoder::append(m_buffer, address, value, flags);
+    qToBigEndian<qint32>(m_buffer.size()-offset-4, m_buffer.data()+offset);
+    m_count++;
+}
+
+//-------------------------------------------------------------------------------------------------
+// MESSAGE
+//-------------------------------------------------------------------------------------------------
+
+QByteArray
+WPN114::Network::OSCMessage::
+encode() const
+{
+    QByteArray data;
+    OSCEncoder::append(data, m_method, m_arguments);
+    return data;
+}
+
+QString
+WPN114::Network::OSCMessage::
+typetag(QVariant const& argument) const
+{
+    return OSCEncoder::typetag(argument);
+}
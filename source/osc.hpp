@@ -6,10 +6,387 @@
 #include <QVector2D>
 #include <QVector3D>
 #include <QVector4D>
+#include <QtEndian>
+#include <string_view>
+#include <cstring>
+
+#include "value.hpp"
 
 namespace WPN114  {
 namespace Network {
 
+//=================================================================================================
+class OSCArgument
+//=================================================================================================
+// a single encoded argument, pointing straight into the packet it was read from
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    OSCArgument(char tag, const char* data) :
+        m_tag(tag), m_data(data) {}
+
+    //---------------------------------------------------------------------------------------------
+    char
+    tag() const { return m_tag; }
+
+    const char*
+    data() const { return m_data; }
+
+    //---------------------------------------------------------------------------------------------
+    int32_t
+    to_int() const;
+
+    int64_t
+    to_int64() const;
+
+    float
+    to_float() const;
+
+    double
+    to_double() const;
+
+    uint64_t
+    to_timetag() const { return static_cast<uint64_t>(to_int64()); }
+
+    bool
+    to_bool() const { return m_tag == 'T'; }
+
+    std::string_view
+    to_string() const { return std::string_view(m_data); }
+
+    std::string_view
+    to_blob() const;
+
+    //---------------------------------------------------------------------------------------------
+    QVariant
+    to_variant() const;
+
+    //---------------------------------------------------------------------------------------------
+    static int64_t
+    size(char tag, const char* data, size_t remaining);
+    // returns the padded size of the argument starting at 'data',
+    // or -1 if it would overrun the 'remaining' bytes
+
+private:
+
+    char
+    m_tag;
+
+    const char*
+    m_data;
+};
+
+//=================================================================================================
+class OSCView
+//=================================================================================================
+// non-owning view over an encoded OSC message (e.g. a mongoose receive buffer)
+// address, typetag and arguments are bounds-checked once at construction and read in place,
+// nothing is allocated until the caller asks for QString/QVariant conversions
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    class const_iterator
+    //---------------------------------------------------------------------------------------------
+    {
+    public:
+
+        const_iterator(const char* tag, const char* data, const char* end) :
+            m_tag(tag), m_data(data), m_end(end) {}
+
+        OSCArgument
+        operator*() const { return OSCArgument(*m_tag, m_data); }
+
+        const_iterator&
+        operator++()
+        {
+            m_data += OSCArgument::size(*m_tag, m_data, m_end-m_data);
+            ++m_tag;
+            return *this;
+        }
+
+        bool
+        operator!=(const_iterator const& rhs) const { return m_tag != rhs.m_tag; }
+
+    private:
+
+        const char*
+        m_tag;
+
+        const char*
+        m_data,
+        *m_end;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    OSCView(const char* data, size_t size);
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    valid() const { return m_valid; }
+
+    const char*
+    data() const { return m_data; }
+
+    size_t
+    size() const { return m_size; }
+    // the buffer the view was built from, whether it turned out to be valid or not
+
+    std::string_view
+    address() const { return m_address; }
+
+    std::string_view
+    typetag() const { return m_typetag; }
+    // without the leading ','
+
+    const char*
+    argument_data() const { return m_arguments; }
+    // first byte after the typetag
+
+    size_t
+    count() const { return m_typetag.size(); }
+
+    //---------------------------------------------------------------------------------------------
+    const_iterator
+    begin() const { return const_iterator(m_typetag.data(), m_arguments, m_end); }
+
+    const_iterator
+    end() const { return const_iterator(m_typetag.data()+m_typetag.size(), m_end, m_end); }
+
+    //---------------------------------------------------------------------------------------------
+    QString
+    method() const { return QString::fromUtf8(m_address.data(), m_address.size()); }
+
+    QVariant
+    arguments() const;
+    // single argument is returned as is, multiple arguments as a QVariantList
+
+    //---------------------------------------------------------------------------------------------
+    size_t
+    read(float* dst, size_t max) const;
+    // reads the leading run of 'f' arguments straight into 'dst', returns how many were read
+
+    size_t
+    read(int32_t* dst, size_t max) const;
+    // same for 'i' arguments
+
+private:
+
+    std::string_view
+    m_address,
+    m_typetag;
+
+    const char*
+    m_data = nullptr,
+    *m_arguments = nullptr,
+    *m_end = nullptr;
+
+    size_t
+    m_size = 0;
+
+    bool
+    m_valid = false;
+};
+
+//=================================================================================================
+struct OSCTimetag
+//=================================================================================================
+// NTP-formatted timetags: seconds since 1900 in the upper 32 bits, fraction in the lower 32
+{
+    static constexpr uint64_t
+    immediate = 1;
+
+    //---------------------------------------------------------------------------------------------
+    static uint64_t
+    from_msecs(int64_t msecs);
+    // from milliseconds since unix epoch
+
+    static int64_t
+    to_msecs(uint64_t timetag);
+
+    //---------------------------------------------------------------------------------------------
+    static uint64_t
+    now();
+
+    static int64_t
+    delay(uint64_t timetag);
+    // milliseconds until 'timetag' is due, 0 if immediate or already past
+};
+
+//=================================================================================================
+struct OSCPacket
+//=================================================================================================
+// an OSC packet is either a single message or a (possibly nested) #bundle
+{
+    static constexpr int
+    max_depth = 8;
+
+    //---------------------------------------------------------------------------------------------
+    static bool
+    is_bundle(const char* data, size_t size)
+    {
+        return size >= 16 && memcmp(data, "#bundle", 8) == 0;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    template<typename _Callback> static bool
+    parse(const char* data, size_t size, _Callback&& callback,
+          uint64_t timetag = OSCTimetag::immediate, int depth = 0)
+    // calls callback(OSCView const&, uint64_t timetag) for every message in the packet,
+    // descending into nested bundles. returns false on malformed input
+    {
+        if (!is_bundle(data, size)) {
+            OSCView view(data, size);
+            if (view.valid())
+                callback(view, timetag);
+            return view.valid();
+        }
+
+        if (depth >= max_depth)
+            return false;
+
+        timetag = qFromBigEndian<quint64>(data+8);
+        auto element = data+16;
+        auto end = data+size;
+
+        while (end-element >= 4)
+        {
+            auto elsz = qFromBigEndian<qint32>(element);
+            element += 4;
+
+            if (elsz < 0 || elsz > end-element)
+                return false;
+
+            if (!parse(element, elsz, callback, timetag, depth+1))
+                return false;
+
+            element += elsz;
+        }
+
+        return element == end;
+    }
+};
+
+//=================================================================================================
+class OSCEncoder
+//=================================================================================================
+// single-pass OSC encoder writing into a caller-owned buffer:
+// typetag and packet size are measured first, the buffer is grown once,
+// then typetag and arguments are written side by side.
+// with a reserved (or thread-local) buffer, steady-state encoding doesn't allocate
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    enum Flags
+    {
+        DoublePrecision = 1
+        // encode doubles as 'd' instead of 'f' (QML reals default to single precision)
+    };
+
+    //---------------------------------------------------------------------------------------------
+    static void
+    append(QByteArray& buffer, QString const& address, QVariant const& arguments, int flags = 0);
+    // appends an encoded message at the end of 'buffer'
+
+    static void
+    append(QByteArray& buffer, std::string_view address, Value const& value, int flags = 0);
+    // typed node values are written directly, without going through QVariant
+
+    //---------------------------------------------------------------------------------------------
+    static QByteArray&
+    encode(QByteArray& buffer, QString const& address, QVariant const& arguments, int flags = 0)
+    // replaces 'buffer' contents with an encoded message, keeping its capacity
+    {
+        buffer.resize(0);
+        append(buffer, address, arguments, flags);
+        return buffer;
+    }
+
+    static QByteArray&
+    encode(QByteArray& buffer, std::string_view address, Value const& value, int flags = 0)
+    {
+        buffer.resize(0);
+        append(buffer, address, value, flags);
+        return buffer;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    static QByteArray&
+    local_buffer();
+    // reusable, pre-reserved output buffer for the calling thread
+
+    //---------------------------------------------------------------------------------------------
+    static QString
+    typetag(QVariant const& argument);
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    static void
+    measure(QVariant const& argument, size_t& ntags, size_t& nbytes, int flags, int depth);
+
+    static void
+    write(QVariant const& argument, char*& tag, char*& data, int flags, int depth);
+};
+
+//=================================================================================================
+class OSCBundleWriter
+//=================================================================================================
+// appends an OSC bundle to a caller-owned buffer,
+// elements are encoded in place and their size prefix patched afterwards
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    OSCBundleWriter(QByteArray& buffer, uint64_t timetag = OSCTimetag::immediate) :
+        m_buffer(buffer) { begin(timetag); }
+
+    //---------------------------------------------------------------------------------------------
+    void
+    begin(uint64_t timetag);
+    // opens a bundle, nested in the current one if any
+
+    void
+    end();
+    // closes the innermost nested bundle
+
+    //---------------------------------------------------------------------------------------------
+    void
+    append(QString const& address, QVariant const& arguments);
+
+    void
+    append(std::string_view address, Value const& value, int flags = 0);
+    // typed node values, see OSCEncoder
+
+    //---------------------------------------------------------------------------------------------
+    void
+    reset(uint64_t timetag = OSCTimetag::immediate)
+    // clears the buffer and starts a new bundle
+    {
+        m_buffer.resize(0);
+        m_depth = 0;
+        m_count = 0;
+        begin(timetag);
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int
+    count() const { return m_count; }
+    // number of messages appended so far
+
+private:
+
+    QByteArray&
+    m_buffer;
+
+    int
+    m_offsets[OSCPacket::max_depth],
+    m_depth = 0,
+    m_count = 0;
+};
+
 //=================================================================================================
 struct OSCMessage
 //=================================================================================================
@@ -26,7 +403,11 @@ struct OSCMessage
     OSCMessage(QString method, QVariant arguments) :
         m_method(method), m_arguments(arguments) {}
 
-    OSCMessage(QByteArray const& data);
+    OSCMessage(OSCView const& view) :
+        m_method(view.method()), m_arguments(view.arguments()) {}
+
+    OSCMessage(QByteArray const& data) :
+        OSCMessage(OSCView(data.constData(), data.size())) {}
 
     //---------------------------------------------------------------------------------------------
     QByteArray
@@ -34,10 +415,6 @@ struct OSCMessage
 
     QString
     typetag(QVariant const& argument) const;
-
-    void
-    append(QByteArray& data, QVariant const& argument) const;
-
 };
 }
 }
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "osc.hpp"
+#include <array>
+#include <tuple>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+template<typename _Valuetype> struct OSCTypeTraits;
+// tag, encoded size and big-endian read/write for fixed-size OSC argument types
+//=================================================================================================
+
+template<> struct OSCTypeTraits<int32_t>
+{
+    static constexpr char tag = 'i';
+    static constexpr size_t size = 4;
+
+    static void
+    write(char* data, int32_t value) { qToBigEndian<qint32>(value, data); }
+
+    static int32_t
+    read(const char* data) { return qFromBigEndian<qint32>(data); }
+
+    static QVariant
+    variant(int32_t value) { return static_cast<int>(value); }
+};
+
+template<> struct OSCTypeTraits<float>
+{
+    static constexpr char tag = 'f';
+    static constexpr size_t size = 4;
+
+    static void
+    write(char* data, float value)
+    {
+        quint32 bits;
+        memcpy(&bits, &value, 4);
+        qToBigEndian<quint32>(bits, data);
+    }
+
+    static float
+    read(const char* data)
+    {
+        float value;
+        auto bits = qFromBigEndian<quint32>(data);
+        memcpy(&value, &bits, 4);
+        return value;
+    }
+
+    static QVariant
+    variant(float value) { return value; }
+};
+
+template<> struct OSCTypeTraits<int64_t>
+{
+    static constexpr char tag = 'h';
+    static constexpr size_t size = 8;
+
+    static void
+    write(char* data, int64_t value) { qToBigEndian<qint64>(value, data); }
+
+    static int64_t
+    read(const char* data) { return qFromBigEndian<qint64>(data); }
+
+    static QVariant
+    variant(int64_t value) { return static_cast<qlonglong>(value); }
+};
+
+template<> struct OSCTypeTraits<double>
+{
+    static constexpr char tag = 'd';
+    static constexpr size_t size = 8;
+
+    static void
+    write(char* data, double value)
+    {
+        quint64 bits;
+        memcpy(&bits, &value, 8);
+        qToBigEndian<quint64>(bits, data);
+    }
+
+    static double
+    read(const char* data)
+    {
+        double value;
+        auto bits = qFromBigEndian<quint64>(data);
+        memcpy(&value, &bits, 8);
+        return value;
+    }
+
+    static QVariant
+    variant(double value) { return value; }
+};
+
+//=================================================================================================
+template<typename... _Args>
+struct OSCTypedMessage
+//=================================================================================================
+// OSC message with a fixed, compile-time signature, e.g.
+// using XYZ = OSCTypedMessage<float, float, float>; // ",fff"
+// typetag, padding and argument sizes are constexpr, values are written/read directly
+// without going through QVariant. output is a regular OSC message, readable by OSCView/OSCMessage
+{
+    static constexpr size_t
+    count = sizeof...(_Args);
+
+    static constexpr size_t
+    typetag_size = (count+2+3) & ~size_t(3);
+
+    static constexpr std::array<char, typetag_size>
+    typetag = {{ ',', OSCTypeTraits<_Args>::tag... }};
+    // zero-padded
+
+    static constexpr size_t
+    arguments_size = (OSCTypeTraits<_Args>::size + ... + 0);
+
+    //---------------------------------------------------------------------------------------------
+    static constexpr size_t
+    size(size_t address_length)
+    // total packet size for an address of 'address_length' bytes
+    {
+        return ((address_length+4) & ~size_t(3)) + typetag_size + arguments_size;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    static bool
+    matches(OSCView const& view)
+    {
+        return view.valid() && view.typetag() == std::string_view(typetag.data()+1, count);
+    }
+
+    //---------------------------------------------------------------------------------------------
+    static void
+    append(QByteArray& buffer, std::string_view address, _Args... arguments)
+    // appends the encoded message to 'buffer', growing it once
+    {
+        auto offset = buffer.size();
+        auto adsz = size(address.size()) - typetag_size - arguments_size;
+        buffer.resize(offset + size(address.size()));
+
+        auto data = buffer.data()+offset;
+        memcpy(data, address.data(), address.size());
+        memset(data+address.size(), 0, adsz-address.size());
+        memcpy(data+adsz, typetag.data(), typetag_size);
+
+        data += adsz+typetag_size;
+        ((OSCTypeTraits<_Args>::write(data, arguments), data += OSCTypeTraits<_Args>::size), ...);
+    }
+
+    //---------------------------------------------------------------------------------------------
+    static QByteArray&
+    encode(QByteArray& buffer, std::string_view address, _Args... arguments)
+    {
+        buffer.resize(0);
+        append(buffer, address, arguments...);
+        return buffer;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    static bool
+    decode(OSCView const& view, _Args&... arguments)
+    // returns false if the view doesn't carry this exact signature
+    {
+        if (!matches(view))
+            return false;
+
+        auto data = view.argument_data();
+        ((arguments = OSCTypeTraits<_Args>::read(data), data += OSCTypeTraits<_Args>::size), ...);
+        return true;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    template<typename _Struct> static void
+    append_struct(QByteArray& buffer, std::string_view address, _Struct const& values)
+    // plain struct whose members match the signature, in order
+    {
+        std::apply([&](auto const&... fields) { append(buffer, address, fields...); },
+                   tie(values));
+    }
+
+    template<typename _Struct> static bool
+    decode_struct(OSCView const& view, _Struct& values)
+    {
+        return std::apply([&](auto&... fields) { return decode(view, fields...); },
+                          tie(values));
+    }
+
+    //---------------------------------------------------------------------------------------------
+    static QVariant
+    arguments(_Args... arguments)
+    // QVariant equivalent of the signature, for use with OSCMessage
+    {
+        if constexpr (count == 1)
+             return OSCTypeTraits<_Args...>::variant(arguments...);
+        else return QVariantList { OSCTypeTraits<_Args>::variant(arguments)... };
+    }
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    template<typename _Struct> static auto
+    tie(_Struct& s)
+    // struct members as a tuple of references, through structured bindings
+    {
+        static_assert(count >= 1 && count <= 8, "unsupported struct size");
+
+        if constexpr (count == 1) {
+            auto& [a] = s;
+            return std::tie(a);
+        } else if constexpr (count == 2) {
+            auto& [a, b] = s;
+            return std::tie(a, b);
+        } else if constexpr (count == 3) {
+            auto& [a, b, c] = s;
+            return std::tie(a, b, c);
+        } else if constexpr (count == 4) {
+            auto& [a, b, c, d] = s;
+            return std::tie(a, b, c, d);
+        } else if constexpr (count == 5) {
+            auto& [a, b, c, d, e] = s;
+            return std::tie(a, b, c, d, e);
+        } else if constexpr (count == 6) {
+            auto& [a, b, c, d, e, f] = s;
+            return std::tie(a, b, c, d, e, f);
+        } else if constexpr (count == 7) {
+            auto& [a, b, c, d, e, f, g] = s;
+            return std::tie(a, b, c, d, e, f, g);
+        } else {
+            auto& [a, b, c, d, e, f, g, h] = s;
+            return std::tie(a, b, c, d, e, f, g, h);
+        }
+    }
+};
+
+}
+}
@@ -0,0 +1,473 @@
+#include "outbox.hpp"
+#include "osc.hpp"
+#include <QThread>
+#include <thread>
+#include <unordered_set>
+
+using namespace WPN114::Network;
+
+WPN114::Network::Outbox::
+Outbox() :
+    m_pool(new Entry[pool_size]),
+    m_free_next(new std::atomic<uint32_t>[pool_size])
+{
+    // chained in order, index+1 being the link to the next one
+    for (int n = 0; n < pool_size; ++n) {
+         m_pool[n].pooled = true;
+         m_pool[n].data.reserve(packet_capacity);
+         m_free_next[n].store(n+1 < pool_size ? n+2 : 0, std::memory_order_relaxed);
+    }
+
+    m_free.store(1, std::memory_order_release);
+}
+
+WPN114::Network::Outbox::
+~Outbox()
+{
+    while (auto entry = dequeue())
+        if (!entry->pooled) delete entry;
+
+    for (auto entry = m_staged_first; entry;) {
+         auto next = entry->next.load(std::memory_order_relaxed);
+         if (!entry->pooled) delete entry;
+         entry = next;
+    }
+
+    // the other end belongs to the manager, which closes it when freed
+    if (m_wakeup[0] != INVALID_SOCKET)
+        closesocket(m_wakeup[0]);
+}
+
+void
+WPN114::Network::Outbox::
+open(mg_mgr& mgr, QObject* context)
+{
+    if (is_open() || !mg_socketpair(m_wakeup, SOCK_STREAM))
+        return;
+
+    mg_add_sock(&mgr, m_wakeup[1], wakeup_handler);
+
+    m_context = context;
+    m_context_thread = context ? context->thread() : nullptr;
+}
+
+void
+WPN114::Network::Outbox::
+wakeup_handler(mg_connection* mgc, int event, void*)
+{
+    // the wakeup byte has done its job by interrupting the poll
+    if (event == MG_EV_RECV)
+        mbuf_remove(&mgc->recv_mbuf, mgc->recv_mbuf.len);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void
+WPN114::Network::Outbox::
+enqueue(Entry* entry)
+// intrusive multiple-producer single-consumer queue (D. Vyukov)
+{
+    entry->next.store(nullptr, std::memory_order_relaxed);
+    auto previous = m_head.exchange(entry, std::memory_order_acq_rel);
+    previous->next.store(entry, std::memory_order_release);
+}
+
+void
+WPN114::Network::Outbox::
+enqueue(Entry* first, Entry* last)
+{
+    // the chain is linked before being published, the consumer only ever reaches it through
+    // the previous head's 'next', once everything behind it is in place
+    last->next.store(nullptr, std::memory_order_relaxed);
+    auto previous = m_head.exchange(last, std::memory_order_acq_rel);
+    previous->next.store(first, std::memory_order_release);
+}
+
+Outbox::Entry*
+WPN114::Network::Outbox::
+dequeue()
+{
+    for (;;)
+    {
+        auto tail = m_tail;
+        auto next = tail->next.load(std::memory_order_acquire);
+
+        if (tail == &m_stub) {
+            if (!next)
+                return nullptr;
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+
+        if (tail != m_head.load(std::memory_order_acquire)) {
+            // a producer is in between its exchange and its store, which won't take long
+            std::this_thread::yield();
+            continue;
+        }
+
+        // tail is the last entry: put the stub back behind it so that it can be taken out
+        enqueue(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+Outbox::Packet*
+WPN114::Network::Outbox::
+acquire()
+{
+    auto head = m_free.load(std::memory_order_acquire);
+
+    while (auto index = uint32_t(head))
+    {
+        auto next = m_free_next[index-1].load(std::memory_order_relaxed);
+        auto desired = (head & 0xffffffff00000000ull)+(1ull << 32)+next;
+
+        if (m_free.compare_exchange_weak(head, desired,
+            std::memory_order_acquire, std::memory_order_acquire))
+            return &m_pool[index-1];
+    }
+
+    auto entry = new Entry;
+    entry->data.reserve(packet_capacity);
+    return entry;
+}
+
+void
+WPN114::Network::Outbox::
+release(Entry* entry)
+{
+    if (!entry->pooled) {
+        delete entry;
+        return;
+    }
+
+    entry->connection = nullptr;
+    entry->kind = Kind::Binary;
+    entry->address = QByteArray();
+
+    // emptied in place, the capacity is what the next packet gets to encode into
+    if (entry->data.capacity() > max_packet_capacity)
+        entry->data = QByteArray();
+
+    entry->data.resize(0);
+
+    if (entry->data.capacity() < packet_capacity)
+        entry->data.reserve(packet_capacity);
+
+    uint32_t index = entry-m_pool.get()+1;
+    auto head = m_free.load(std::memory_order_relaxed);
+
+    do m_free_next[index-1].store(uint32_t(head), std::memory_order_relaxed);
+    while (!m_free.compare_exchange_weak(head, (head & 0xffffffff00000000ull)+(1ull << 32)+index,
+            std::memory_order_release, std::memory_order_relaxed));
+}
+
+void
+WPN114::Network::Outbox::
+push(Packet packet)
+{
+    auto target = acquire();
+    target->connection = packet.connection;
+    target->kind = packet.kind;
+    target->data = std::move(packet.data);
+    target->address = std::move(packet.address);
+    push(target);
+}
+
+void
+WPN114::Network::Outbox::
+push(Packet* packet)
+{
+    auto entry = static_cast<Entry*>(packet);
+
+    if (!m_context || QThread::currentThread() != m_context_thread) {
+        enqueue(entry);
+        wakeup();
+        return;
+    }
+
+    entry->next.store(nullptr, std::memory_order_relaxed);
+
+    if (m_staged_last) {
+        m_staged_last->next.store(entry, std::memory_order_relaxed);
+        m_staged_last = entry;
+        return;
+    }
+
+    // first of this turn: the commit is queued behind whatever the event loop has pending,
+    // so that everything those events push goes along with it
+    m_staged_first = m_staged_last = entry;
+    QMetaObject::invokeMethod(m_context, [this] { commit(); }, Qt::QueuedConnection);
+}
+
+void
+WPN114::Network::Outbox::
+commit()
+{
+    if (!m_staged_first)
+        return;
+
+    enqueue(m_staged_first, m_staged_last);
+    m_staged_first = m_staged_last = nullptr;
+    wakeup();
+}
+
+void
+WPN114::Network::Outbox::
+wakeup()
+{
+    if (is_open() && !m_wakeup_pending.exchange(true, std::memory_order_acq_rel)) {
+        char byte = 0;
+        send(m_wakeup[0], &byte, 1, 0);
+    }
+}
+
+void
+WPN114::Network::Outbox::
+flush(mg_mgr& mgr)
+{
+    // cleared first: anything pushed from now on wakes up the next poll
+    m_wakeup_pending.store(false, std::memory_order_release);
+
+    std::unordered_set<mg_connection*> connections;
+    bool listed = false;
+
+    while (auto entry = dequeue())
+    {
+        auto& packet = *entry;
+
+        switch (packet.kind)
+        {
+        case Kind::Datagram:
+        {
+#ifdef WPN114_UDP_BATCHING
+            sockaddr_in address;
+
+            if (m_socket) {
+                if (destination(packet.address, address)) {
+                    m_batch.push_back({ packet.data.constData(), size_t(packet.data.size()), address });
+                    m_batched.push_back(entry);
+                    entry = nullptr;
+                }
+                break;
+            }
+#endif
+            if (auto udp = sender(mgr, packet.address))
+                mg_send(udp, packet.data.constData(), packet.data.size());
+            break;
+        }
+        case Kind::Open:
+        {
+#ifdef WPN114_UDP_BATCHING
+            sockaddr_in address;
+
+            if (m_socket) {
+                destination(packet.address, address);
+                break;
+            }
+#endif
+            sender(mgr, packet.address);
+            break;
+        }
+        case Kind::Close:
+        {
+#ifdef WPN114_UDP_BATCHING
+            m_destinations.remove(packet.address);
+#endif
+            close_sender(packet.address);
+            break;
+        }
+        default:
+        {
+            if (!listed) {
+                // connections the manager still holds, listed once per flush
+                for (auto mgc = mg_next(&mgr, nullptr); mgc; mgc = mg_next(&mgr, mgc))
+                     connections.insert(mgc);
+                listed = true;
+            }
+
+            if (connections.count(packet.connection))
+                coalesce(packet);
+        }
+        }
+
+        if (entry)
+            release(entry);
+    }
+
+    for (auto it = m_frames.begin(); it != m_frames.end();)
+    {
+        if (listed && !connections.count(it.key())) {
+            it = m_frames.erase(it);
+            continue;
+        }
+
+        send_frame(it.key(), it.value());
+        ++it;
+    }
+
+#ifdef WPN114_UDP_BATCHING
+    if (m_batch.isEmpty())
+        return;
+
+    // all of this flush's datagrams, in as few system calls as possible
+    m_socket->send(m_batch.constData(), m_batch.size());
+    m_batch.resize(0);
+
+    for (auto entry : m_batched)
+         release(entry);
+
+    m_batched.resize(0);
+#endif
+}
+
+void
+WPN114::Network::Outbox::
+coalesce(Packet& packet)
+{
+    auto& frame = m_frames[packet.connection];
+
+    if (frame.count && (packet.kind != frame.kind || packet.kind == Kind::Text ||
+        frame.data.size()+packet.data.size()+24 > max_frame_size))
+        send_frame(packet.connection, frame);
+
+    if (frame.count == 0) {
+        // copied rather than moved: the packet's buffer goes back to the pool
+        if (!frame.data.capacity())
+            frame.data.reserve(packet_capacity);
+
+        frame.kind = packet.kind;
+        frame.data.append(packet.data);
+        frame.count = 1;
+        return;
+    }
+
+    if (frame.count == 1) {
+        // the first message becomes the bundle's first element
+        QByteArray bundle;
+        bundle.reserve(frame.data.size()+packet.data.size()+24);
+        bundle.resize(16);
+
+        memcpy(bundle.data(), "#bundle", 8);
+        qToBigEndian<quint64>(OSCTimetag::immediate, bundle.data()+8);
+        qSwap(bundle, frame.data);
+
+        char size[4];
+        qToBigEndian<qint32>(bundle.size(), size);
+        frame.data.append(size, 4).append(bundle);
+    }
+
+    char size[4];
+    qToBigEndian<qint32>(packet.data.size(), size);
+    frame.data.append(size, 4).append(packet.data);
+
+    frame.count++;
+}
+
+void
+WPN114::Network::Outbox::
+send_frame(mg_connection* connection, Frame& frame)
+{
+    if (frame.count == 0)
+        return;
+
+    mg_send_websocket_frame(connection,
+        frame.kind == Kind::Binary ? WEBSOCKET_OP_BINARY : WEBSOCKET_OP_TEXT,
+        frame.data.constData(), frame.data.size());
+
+    m_counters.frames.fetch_add(1, std::memory_order_relaxed);
+    m_counters.packets.fetch_add(frame.count, std::memory_order_relaxed);
+
+    // kept for the connection's next frame
+    frame.data.resize(0);
+    frame.count = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+#ifdef WPN114_UDP_BATCHING
+//-------------------------------------------------------------------------------------------------
+
+bool
+WPN114::Network::Outbox::
+destination(QByteArray const& address, sockaddr_in& result)
+{
+    auto it = m_destinations.constFind(address);
+    if (it != m_destinations.constEnd()) {
+        result = it.value();
+        return true;
+    }
+
+    if (!UdpSocket::resolve(address, result))
+        return false;
+
+    m_destinations.insert(address, result);
+    return true;
+}
+
+#endif
+//-------------------------------------------------------------------------------------------------
+
+mg_connection*
+WPN114::Network::Outbox::
+sender(mg_mgr& mgr, QByteArray const& address)
+{
+    if (auto udp = m_senders.value(address))
+        return udp;
+
+    auto udp = mg_connect(&mgr, address.constData(), sender_handler);
+    if (!udp)
+        return nullptr;
+
+    udp->user_data = this;
+    m_senders.insert(address, udp);
+
+    return udp;
+}
+
+void
+WPN114::Network::Outbox::
+close_sender(QByteArray const& address)
+{
+    // whatever is still in its send buffer goes out first
+    if (auto udp = m_senders.take(address))
+        udp->flags |= MG_F_SEND_AND_CLOSE;
+}
+
+void
+WPN114::Network::Outbox::
+sender_handler(mg_connection* mgc, int event, void*)
+{
+    auto outbox = static_cast<Outbox*>(mgc->user_data);
+
+    switch (event)
+    {
+    case MG_EV_RECV:
+        // senders don't expect anything back
+        mbuf_remove(&mgc->recv_mbuf, mgc->recv_mbuf.len);
+        break;
+    case MG_EV_CLOSE:
+    {
+        // closed by mongoose (e.g. on error) or by close_sender: forget it either way
+        for (auto it = outbox->m_senders.begin(); it != outbox->m_senders.end(); ++it) {
+            if (it.value() == mgc) {
+                outbox->m_senders.erase(it);
+                break;
+            }
+        }
+        break;
+    }
+    }
+}
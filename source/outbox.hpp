@@ -0,0 +1,264 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include <dependencies/mongoose/mongoose.h>
+
+#include "udp.hpp"
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+class Outbox
+//=================================================================================================
+// a device's outgoing packets: pushed from any thread (qt, qml, audio) without locking,
+// sent by the thread polling the device's manager, which is woken up as soon as there is
+// something to send instead of on its next poll timeout.
+// packets come from a preallocated pool and keep their buffer's capacity once sent,
+// so that steady-state sends don't allocate.
+// consecutive OSC frames for the same connection are sent as a single bundle, and everything
+// a qt event loop turn pushes is flushed at once, see open(). text frames are never merged:
+// peers expect exactly one json command per frame
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    enum class Kind : uint8_t
+    {
+        Binary,
+        // websocket frames holding an OSC message or bundle, coalesced into one bundle
+        Text,
+        // json or anything else, sent as is
+        Datagram,
+        // udp, to 'address'
+        Open,
+        Close
+        // creates or closes the udp sender for 'address' ahead of (or after) its datagrams
+    };
+
+    struct Packet
+    {
+        mg_connection*
+        connection = nullptr;
+
+        Kind
+        kind = Kind::Binary;
+
+        QByteArray
+        data,
+        address;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    static constexpr int
+    max_frame_size = 65536,
+    // coalesced frames stop growing past this size
+    pool_size = 1024,
+    packet_capacity = 256,
+    max_packet_capacity = 65536;
+    // pooled buffers are reserved at packet_capacity, and shrunk back to it
+    // if a large packet made them grow past max_packet_capacity
+
+    //---------------------------------------------------------------------------------------------
+    struct Counters
+    {
+        std::atomic<uint64_t>
+        frames { 0 },
+        packets { 0 };
+        // websocket frames sent, and the packets they were coalesced from
+    };
+
+    //---------------------------------------------------------------------------------------------
+    Outbox();
+
+    Outbox(Outbox const&) = delete;
+
+    ~Outbox();
+
+    //---------------------------------------------------------------------------------------------
+    void
+    open(mg_mgr& mgr, QObject* context = nullptr);
+    // registers the wakeup socket with 'mgr', before it starts being polled.
+    // packets pushed from the thread of 'context' are held back until the end of its current
+    // event loop turn, then handed over all together: a turn's frames are coalesced as one
+
+    bool
+    is_open() const { return m_wakeup[0] != INVALID_SOCKET; }
+
+#ifdef WPN114_UDP_BATCHING
+    void
+    set_socket(UdpSocket* socket) { m_socket = socket; }
+    // datagrams go out through 'socket', batched per flush, instead of a mongoose sender per peer
+#endif
+
+    //---------------------------------------------------------------------------------------------
+    Packet*
+    acquire();
+    // thread-safe: an empty packet to fill in place (encoding straight into its data)
+    // and hand to push. falls back to the heap when the pool runs dry
+
+    void
+    push(Packet* packet);
+    // thread-safe, 'packet' has to come from acquire()
+
+    void
+    push(Packet packet);
+    // thread-safe, for control packets: moved into an acquired one
+
+    void
+    flush(mg_mgr& mgr);
+    // polling thread only: hands everything that has been pushed to mongoose,
+    // packets for connections that have been closed in the meantime are dropped
+
+    Counters const&
+    counters() const { return m_counters; }
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    struct Entry : Packet
+    {
+        std::atomic<Entry*>
+        next { nullptr };
+
+        bool
+        pooled = false;
+    };
+
+    void
+    enqueue(Entry* entry);
+
+    void
+    enqueue(Entry* first, Entry* last);
+    // a chain of entries, made visible to the consumer all at once
+
+    void
+    commit();
+    // context thread: enqueues what has been staged since the last commit
+
+    void
+    wakeup();
+
+    Entry*
+    dequeue();
+
+    void
+    release(Entry* entry);
+    // polling thread only: back to the pool, or deleted if it came from the heap
+
+    static void
+    wakeup_handler(mg_connection* mgc, int event, void* data);
+
+    //---------------------------------------------------------------------------------------------
+    struct Frame
+    {
+        Kind
+        kind = Kind::Binary;
+
+        QByteArray
+        data;
+
+        int
+        count = 0;
+    };
+
+    void
+    coalesce(Packet& packet);
+    // appends 'packet' to its connection's pending frame, sending that frame first if it can't
+
+    void
+    send_frame(mg_connection* connection, Frame& frame);
+
+    QHash<mg_connection*, Frame>
+    m_frames;
+    // polling thread only, sent at the end of each flush.
+    // kept afterwards for their buffers, until their connection is closed
+
+    //---------------------------------------------------------------------------------------------
+    mg_connection*
+    sender(mg_mgr& mgr, QByteArray const& address);
+    // connected udp socket for 'address', created on first use and reused afterwards
+
+    void
+    close_sender(QByteArray const& address);
+
+    static void
+    sender_handler(mg_connection* mgc, int event, void* data);
+
+    //---------------------------------------------------------------------------------------------
+    std::atomic<Entry*>
+    m_head { &m_stub };
+    // producers append here
+
+    Entry*
+    m_tail = &m_stub;
+    // consumer side
+
+    Entry
+    m_stub;
+
+    std::unique_ptr<Entry[]>
+    m_pool;
+
+    std::unique_ptr<std::atomic<uint32_t>[]>
+    m_free_next;
+    // free list links, by pool index+1 (0 ends the list)
+
+    std::atomic<uint64_t>
+    m_free { 0 };
+    // free list head, pool index+1 in the lower 32 bits, and a tag in the upper 32
+    // that is bumped on every change so that a stale head can't be swapped in (ABA)
+
+    QObject*
+    m_context = nullptr;
+
+    QThread*
+    m_context_thread = nullptr;
+
+    Entry
+    *m_staged_first = nullptr,
+    *m_staged_last = nullptr;
+    // context thread only, pushed during the current event loop turn
+
+    std::atomic<bool>
+    m_wakeup_pending { false };
+    // a single byte is written until the polling thread catches up
+
+    sock_t
+    m_wakeup[2] = { INVALID_SOCKET, INVALID_SOCKET };
+
+    QHash<QByteArray, mg_connection*>
+    m_senders;
+    // polling thread only
+
+    Counters
+    m_counters;
+
+#ifdef WPN114_UDP_BATCHING
+    //---------------------------------------------------------------------------------------------
+    bool
+    destination(QByteArray const& address, sockaddr_in& result);
+    // resolved once per peer address
+
+    UdpSocket*
+    m_socket = nullptr;
+
+    QHash<QByteArray, sockaddr_in>
+    m_destinations;
+
+    QVector<UdpSocket::Datagram>
+    m_batch;
+
+    QVector<Entry*>
+    m_batched;
+    // entries whose data is referenced by m_batch, deleted once it has been sent
+#endif
+};
+
+}
+}
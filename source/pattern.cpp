@@ -0,0 +1,206 @@
+#include "pattern.hpp"
+#include "node.hpp"
+#include <algorithm>
+
+using namespace WPN114::Network;
+
+static inline bool
+starts_with(QChar const* name, QChar const* name_end, QString const& text)
+{
+    return name_end-name >= text.size() &&
+           std::equal(text.constBegin(), text.constEnd(), name);
+}
+
+WPN114::Network::OSCPattern::
+OSCPattern(QString const& pattern)
+{
+    for (const auto& segment : pattern.split('/', QString::SkipEmptyParts))
+         m_segments << compile(segment);
+}
+
+OSCPattern::Segment
+WPN114::Network::OSCPattern::
+compile(QString const& segment)
+{
+    Segment compiled;
+    QString literal;
+
+    auto push = [&](Token token) {
+        if (!literal.isEmpty()) {
+            compiled.tokens << Token { Token::Literal, literal };
+            literal.clear();
+        }
+        compiled.tokens << token;
+        compiled.literal = false;
+    };
+
+    for (int n = 0; n < segment.size(); ++n)
+    {
+        auto c = segment[n];
+
+        if (c == '*') {
+            // consecutive stars are redundant
+            if (literal.isEmpty() && !compiled.tokens.isEmpty() &&
+                compiled.tokens.last().kind == Token::Star)
+                continue;
+            push(Token { Token::Star });
+        }
+
+        else if (c == '?')
+            push(Token { Token::Any });
+
+        else if (c == '[' && segment.indexOf(']', n+1) > 0)
+        {
+            auto close = segment.indexOf(']', n+1);
+            Token token { Token::Set };
+            int i = n+1;
+
+            if (segment[i] == '!') {
+                token.negate = true;
+                ++i;
+            }
+
+            for (; i < close; ++i) {
+                if (i+2 < close && segment[i+1] == '-') {
+                    // range
+                    token.text.append(segment[i]).append(segment[i+2]);
+                    i += 2;
+                }
+                else token.text.append(segment[i]).append(segment[i]);
+            }
+
+            push(token);
+            n = close;
+        }
+
+        else if (c == '{' && segment.indexOf('}', n+1) > 0)
+        {
+            auto close = segment.indexOf('}', n+1);
+            Token token { Token::Alternatives };
+            token.alternatives = segment.mid(n+1, close-n-1).split(',');
+            push(token);
+            n = close;
+        }
+
+        else literal.append(c);
+    }
+
+    if (!literal.isEmpty())
+        compiled.tokens << Token { Token::Literal, literal };
+
+    return compiled;
+}
+
+bool
+WPN114::Network::OSCPattern::
+match(Token const* token, Token const* end, QChar const* name, QChar const* name_end)
+{
+    for (; token != end; ++token)
+    {
+        switch (token->kind)
+        {
+        case Token::Literal:
+        {
+            if (!starts_with(name, name_end, token->text))
+                return false;
+            name += token->text.size();
+            break;
+        }
+        case Token::Any:
+            if (name == name_end)
+                return false;
+            ++name;
+            break;
+
+        case Token::Set:
+        {
+            if (name == name_end)
+                return false;
+
+            bool in = false;
+            for (int n = 0; n < token->text.size() && !in; n += 2)
+                 in = *name >= token->text[n] && *name <= token->text[n+1];
+
+            if (in == token->negate)
+                return false;
+            ++name;
+            break;
+        }
+        case Token::Alternatives:
+            for (const auto& alternative : token->alternatives)
+                 if (starts_with(name, name_end, alternative) &&
+                     match(token+1, end, name+alternative.size(), name_end))
+                     return true;
+            return false;
+
+        case Token::Star:
+            if (token+1 == end)
+                return true;
+            // by offset: a pointer before 'name' can't be formed
+            for (auto n = name_end-name; n >= 0; --n)
+                 if (match(token+1, end, name+n, name_end))
+                     return true;
+            return false;
+        }
+    }
+
+    return name == name_end;
+}
+
+bool
+WPN114::Network::OSCPattern::
+match(int segment, QString const& name) const
+{
+    auto& tokens = m_segments[segment].tokens;
+    return match(tokens.constData(), tokens.constData()+tokens.size(),
+                 name.constData(), name.constData()+name.size());
+}
+
+bool
+WPN114::Network::OSCPattern::
+matches(QString const& path) const
+{
+    auto names = path.splitRef('/', QString::SkipEmptyParts);
+    if (names.count() != m_segments.count())
+        return false;
+
+    for (int n = 0; n < names.count(); ++n)
+    {
+        auto& tokens = m_segments[n].tokens;
+        auto& name = names[n];
+
+        if (!match(tokens.constData(), tokens.constData()+tokens.size(),
+                   name.constData(), name.constData()+name.size()))
+            return false;
+    }
+
+    return true;
+}
+
+void
+WPN114::Network::OSCPattern::
+resolve(Node* root, QVector<Node*>& nodes) const
+{
+    QVector<Node*> frontier { root }, next;
+
+    for (int n = 0; n < m_segments.count() && !frontier.isEmpty(); ++n)
+    {
+        auto& segment = m_segments[n];
+        next.clear();
+
+        for (const auto& node : frontier)
+        {
+            if (segment.literal) {
+                if (auto subnode = node->subnode(segment.tokens[0].text))
+                    next << subnode;
+            }
+            else for (const auto& subnode : node->subnodes())
+                 if (match(n, subnode->name()))
+                     next << subnode;
+        }
+
+        std::swap(frontier, next);
+    }
+
+    nodes = frontier;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <string_view>
+
+namespace WPN114  {
+namespace Network {
+
+class Node;
+
+//=================================================================================================
+class OSCPattern
+//=================================================================================================
+// OSC 1.0 address pattern ('?', '*', '[a-z]', '[!abc]', '{foo,bar}'),
+// compiled once into per-segment token lists and matched against node names
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    OSCPattern() {}
+
+    OSCPattern(QString const& pattern);
+
+    //---------------------------------------------------------------------------------------------
+    static bool
+    is_pattern(std::string_view address)
+    {
+        return address.find_first_of("*?[{") != std::string_view::npos;
+    }
+
+    static bool
+    is_pattern(QString const& address)
+    {
+        for (const auto& c : address)
+             if (c == '*' || c == '?' || c == '[' || c == '{')
+                 return true;
+        return false;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    match(int segment, QString const& name) const;
+    // matches 'name' against the pattern's nth segment
+
+    bool
+    matches(QString const& path) const;
+    // matches a full node path, segment by segment
+
+    //---------------------------------------------------------------------------------------------
+    void
+    resolve(Node* root, QVector<Node*>& nodes) const;
+    // collects every node below 'root' matching the whole pattern
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    struct Token
+    {
+        enum Kind { Literal, Any, Star, Set, Alternatives };
+
+        Kind
+        kind;
+
+        QString
+        text;
+        // literal text, or [lo, hi] character pairs for sets
+
+        QStringList
+        alternatives;
+
+        bool
+        negate = false;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    struct Segment
+    {
+        QVector<Token>
+        tokens;
+
+        bool
+        literal = true;
+        // no wildcard: can be looked up directly
+    };
+
+    //---------------------------------------------------------------------------------------------
+    static Segment
+    compile(QString const& segment);
+
+    static bool
+    match(Token const* token, Token const* end, QChar const* name, QChar const* name_end);
+
+    //---------------------------------------------------------------------------------------------
+    QVector<Segment>
+    m_segments;
+};
+
+}
+}
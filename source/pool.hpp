@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+template<typename _T, size_t _SlabSize = 256>
+class SlabPool
+//=================================================================================================
+// fixed-size storage for objects of type _T, carved out of large slabs:
+// released slots are recycled through a free list, and the memory itself
+// is only given back, all at once, when the pool is destroyed
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    SlabPool() = default;
+
+    SlabPool(SlabPool const&) = delete;
+
+    SlabPool&
+    operator=(SlabPool const&) = delete;
+
+    //---------------------------------------------------------------------------------------------
+    void*
+    allocate()
+    // uninitialized storage for a single _T
+    {
+        if (m_free) {
+            auto slot = m_free;
+            m_free = slot->next;
+            return slot->storage;
+        }
+
+        if (m_next == _SlabSize) {
+            m_slabs.emplace_back(new Slot[_SlabSize]);
+            m_next = 0;
+        }
+
+        return m_slabs.back()[m_next++].storage;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    void
+    release(void* object)
+    // object has to be destroyed already
+    {
+        auto slot = reinterpret_cast<Slot*>(object);
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    size_t
+    capacity() const { return m_slabs.size()*_SlabSize; }
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    union Slot
+    {
+        Slot*
+        next;
+
+        alignas(_T) unsigned char
+        storage[sizeof(_T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>>
+    m_slabs;
+
+    Slot*
+    m_free = nullptr;
+
+    size_t
+    m_next = _SlabSize;
+};
+
+}
+}
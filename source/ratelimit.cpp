@@ -0,0 +1,47 @@
+#include "ratelimit.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace WPN114::Network;
+
+void
+WPN114::Network::RateLimiter::
+set_rate(uint32_t connection, double rate)
+{
+    if (connection >= m_buffers.size())
+        m_buffers.resize(connection+1);
+
+    // pending nodes are still flushed on their deadline, whatever the new rate
+    m_buffers[connection].interval = rate > 0 ? std::max<int64_t>(1, std::lround(1000/rate)) : 0;
+}
+
+int64_t
+WPN114::Network::RateLimiter::
+defer(uint32_t connection, uint32_t node, int64_t now)
+{
+    auto& buffer = m_buffers[connection];
+
+    if (node >= buffer.marked.size())
+        buffer.marked.resize(node+1);
+
+    if (buffer.marked[node])
+        return -1;
+
+    buffer.marked[node] = true;
+    buffer.pending << node;
+
+    if (buffer.pending.size() > 1)
+        return -1;
+
+    // after a quiet period, the first change goes out on the next flush
+    buffer.deadline = std::max(now, buffer.last+buffer.interval);
+    return buffer.deadline;
+}
+
+void
+WPN114::Network::RateLimiter::
+remove_connection(uint32_t connection)
+{
+    if (connection < m_buffers.size())
+        m_buffers[connection] = Buffer();
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QVector>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+class RateLimiter
+//=================================================================================================
+// per-connection maximum rate for value updates: a rate-limited connection only keeps
+// the ids of the nodes that changed since its last flush, their latest values are read
+// and sent together when it's due, at most 'rate' times per second.
+// times are in milliseconds, from any monotonic clock
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    void
+    set_rate(uint32_t connection, double rate);
+    // updates per second, 0 for no limit
+
+    bool
+    limited(uint32_t connection) const
+    {
+        return connection < m_buffers.size() && m_buffers[connection].interval > 0;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int64_t
+    defer(uint32_t connection, uint32_t node, int64_t now);
+    // returns the connection's flush deadline if it had nothing pending yet, -1 otherwise.
+    // a node changing again before the flush only keeps its place
+
+    template<typename _Flush> int64_t
+    flush(int64_t now, _Flush&& flush)
+    // calls flush(connection, nodes) for every connection that is due,
+    // returns the next deadline, or -1 if nothing is left pending
+    {
+        int64_t next = -1;
+
+        for (uint32_t connection = 0; connection < m_buffers.size(); ++connection)
+        {
+            auto& buffer = m_buffers[connection];
+            if (buffer.pending.isEmpty())
+                continue;
+
+            if (buffer.deadline > now) {
+                if (next < 0 || buffer.deadline < next)
+                    next = buffer.deadline;
+                continue;
+            }
+
+            QVector<uint32_t> nodes;
+            nodes.swap(buffer.pending);
+            buffer.last = now;
+
+            for (auto node : nodes)
+                 buffer.marked[node] = false;
+
+            flush(connection, nodes);
+        }
+
+        return next;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    void
+    remove_connection(uint32_t connection);
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    struct Buffer
+    {
+        int64_t
+        interval = 0,
+        deadline = 0,
+        last = std::numeric_limits<int64_t>::min()/2;
+        // last flush, far enough in the past for the first one not to wait
+
+        QVector<uint32_t>
+        pending;
+        // in the order they first changed
+
+        std::vector<bool>
+        marked;
+        // by node id, whether it is in 'pending' already
+    };
+
+    std::vector<Buffer>
+    m_buffers;
+    // by connection id
+};
+
+}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+template<typename _T, size_t _Capacity>
+class SPSCRing
+//=================================================================================================
+// bounded single-producer single-consumer ring of pre-allocated slots:
+// the producer fills a slot in place before publishing it, the consumer reads it in place
+// before releasing it, nothing is allocated or copied in between
+{
+    static_assert((_Capacity & (_Capacity-1)) == 0, "capacity has to be a power of two");
+
+public:
+
+    //---------------------------------------------------------------------------------------------
+    SPSCRing() : m_slots(new _T[_Capacity]) {}
+
+    static constexpr size_t
+    capacity() { return _Capacity; }
+
+    //---------------------------------------------------------------------------------------------
+    _T*
+    acquire()
+    // producer: next free slot, or nullptr if the ring is full
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        if (head-m_tail.load(std::memory_order_acquire) >= _Capacity)
+            return nullptr;
+
+        return &m_slots[head & (_Capacity-1)];
+    }
+
+    void
+    commit() { m_head.fetch_add(1, std::memory_order_release); }
+    // producer: publishes the slot returned by acquire()
+
+    //---------------------------------------------------------------------------------------------
+    _T*
+    front()
+    // consumer: oldest published slot, or nullptr if the ring is empty
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &m_slots[tail & (_Capacity-1)];
+    }
+
+    void
+    pop() { m_tail.fetch_add(1, std::memory_order_release); }
+    // consumer: gives the slot returned by front() back to the producer
+
+private:
+
+    std::unique_ptr<_T[]>
+    m_slots;
+
+    alignas(64) std::atomic<size_t>
+    m_head { 0 };
+
+    alignas(64) std::atomic<size_t>
+    m_tail { 0 };
+    // on separate cache lines, each being written by a single thread
+};
+
+}
+}
@@ -1,33 +1,47 @@
 #include "server.hpp"
 #include <QJsonDocument>
+#include <QMetaMethod>
+#include <algorithm>
 
 using namespace WPN114::Network;
 
 WPN114::Network::Server::
 Server()
 {
-    mg_mgr_init(&m_tcp, this);
-    mg_mgr_init(&m_udp, this);
+    mg_mgr_init(&m_mgr, this);
+    m_tree.set_observer(this);
+
+    m_clock.start();
+    m_flush_timer.setSingleShot(true);
+    m_flush_timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&m_flush_timer, &QTimer::timeout, this, &Server::on_flush_timeout);
 }
 
 void
 WPN114::Network::Server::
 componentComplete()
 {
-    char
-    s_tcp   [5],
-    s_udp   [5],
-    udp_hdr [32] = "udp://";
-
+    char s_tcp[6];
     sprintf(s_tcp, "%d", m_tcp_port);
-    sprintf(s_udp, "%d", m_udp_port);
-    strcat(udp_hdr, s_udp);
 
-    m_tcp_connection = mg_bind(&m_tcp, s_tcp, ws_event_handler);
-    m_udp_connection = mg_bind(&m_udp, udp_hdr, udp_event_handler);
+    m_tcp_connection = mg_bind(&m_mgr, s_tcp, ws_event_handler);
     mg_set_protocol_http_websocket(m_tcp_connection);
 
+#ifdef WPN114_UDP_BATCHING
+    // osc over udp doesn't go through mongoose, see udp_poll
+    if  (m_udp.bind(m_udp_port))
+         m_outbox.set_socket(&m_udp);
+    else qWarning() << "[Server] could not bind udp port" << m_udp_port;
+#else
+    auto udp = QByteArray("udp://").append(QByteArray::number(m_udp_port));
+    if (!mg_bind(&m_mgr, udp.constData(), udp_event_handler))
+        qWarning() << "[Server] could not bind udp port" << m_udp_port;
+#endif
+
     m_zeroconf.startServicePublish(CSTR(m_name), "_oscjson._tcp", "local", m_tcp_port);
+    m_host_info = QJsonDocument(info()).toJson(QJsonDocument::Compact);
+    m_tree.set_publishing(true);
+    m_outbox.open(m_mgr, this);
     m_running = true;
 
     poll();
@@ -38,15 +52,22 @@ WPN114::Network::Server::
 stop()
 {
     m_running = false;
-    m_mgthread.join();
+
+    if (m_mgthread.joinable())
+        m_mgthread.join();
+
+#ifdef WPN114_UDP_BATCHING
+    if (m_udpthread.joinable())
+        m_udpthread.join();
+#endif
 }
 
 WPN114::Network::Server::
 ~Server()
 {
     stop();
-    mg_mgr_free(&m_tcp);
-    mg_mgr_free(&m_udp);
+    m_tree.set_observer(nullptr);
+    mg_mgr_free(&m_mgr);
 }
 
 void
@@ -54,15 +75,21 @@ WPN114::Network::Server::
 poll()
 {
     m_mgthread = std::thread(&Server::server_poll, this);
+
+#ifdef WPN114_UDP_BATCHING
+    if (m_udp.is_open())
+        m_udpthread = std::thread(&Server::udp_poll, this);
+#endif
 }
 
 void
 WPN114::Network::Server::
 server_poll()
 {
+    // the outbox's wakeup socket is part of the polled set
     while (m_running) {
-        mg_mgr_poll(&m_tcp, 200);
-        mg_mgr_poll(&m_udp, 200);
+        mg_mgr_poll(&m_mgr, poll_timeout);
+        m_outbox.flush(m_mgr);
     }
 }
 
@@ -94,20 +121,19 @@ ws_event_handler(mg_connection *mgc, int event, void *data)
     }
     case MG_EV_HTTP_REQUEST:
     {
-        http_message* hm = static_cast<http_message*>(data);
-        auto uri = QString::fromUtf8(hm->uri.p, hm->uri.len);
-        auto qst = QString::fromUtf8(hm->query_string.p, hm->query_string.len);
-
-        QMetaObject::invokeMethod(server, "on_http_request",
-            Qt::QueuedConnection,
-            Q_ARG(mg_connection*, mgc),
-            Q_ARG(QString, uri),
-            Q_ARG(QString, qst));
-
+        server->serve_http_request(mgc, static_cast<http_message*>(data));
+        break;
+    }
+    case MG_EV_SEND:
+    {
+        // plain http connections only send responses, nothing to do once they are written
+        if (!(mgc->flags & MG_F_IS_WEBSOCKET))
+            server->write_http_chunks(mgc);
         break;
     }
     case MG_EV_CLOSE:
     {
+        server->m_http_responses.writers.erase(mgc);
         QMetaObject::invokeMethod(server, "on_disconnection",
             Qt::QueuedConnection,
             Q_ARG(mg_connection*, mgc));
@@ -118,122 +144,297 @@ ws_event_handler(mg_connection *mgc, int event, void *data)
 
 void
 WPN114::Network::Server::
-udp_event_handler(mg_connection *mgc, int event, void *data)
+queue_udp_datagram(const char* data, size_t size)
+{
+    // messages are validated and copied out of their datagram (and bundle) here,
+    // the qt thread reads them straight from the ring
+    OSCPacket::parse(data, size, [this](OSCView const& view, uint64_t timetag)
+    {
+        auto message = m_udp_messages.acquire();
+        if (!message) {
+            m_udp_overflows.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        message->timetag = timetag;
+        message->size = view.size();
+
+        if  (view.size() <= UdpMessage::inline_size)
+             memcpy(message->data, view.data(), view.size());
+        else message->overflow = QByteArray(view.data(), view.size());
+
+        m_udp_messages.commit();
+    });
+
+    // a single queued call for everything decoded until the qt thread gets to it
+    if (!m_udp_pending.exchange(true, std::memory_order_acq_rel))
+        QMetaObject::invokeMethod(this, "on_udp_messages", Qt::QueuedConnection);
+}
+
+#ifdef WPN114_UDP_BATCHING
+
+void
+WPN114::Network::Server::
+udp_poll()
+{
+    UdpSocket::Datagram datagrams[UdpSocket::batch_size];
+
+    while (m_running)
+    {
+        if (!m_udp.wait(poll_timeout))
+            continue;
+
+        // drain everything that is pending, a batch per system call
+        while (auto count = m_udp.receive(datagrams))
+            for (int n = 0; n < count; ++n)
+                 queue_udp_datagram(datagrams[n].data, datagrams[n].size);
+    }
+}
+
+#else
+
+void
+WPN114::Network::Server::
+udp_event_handler(mg_connection* mgc, int event, void*)
 {
     auto server = static_cast<Server*>(mgc->mgr->user_data);
 
-    switch(event) {
-        case MG_EV_RECV:
-        QMetaObject::invokeMethod(server, "on_udp_datagram",
-            Qt::QueuedConnection,
-            Q_ARG(mg_connection*, mgc));
-            break;
+    if (event == MG_EV_RECV) {
+        server->queue_udp_datagram(mgc->recv_mbuf.buf, mgc->recv_mbuf.len);
+        mbuf_remove(&mgc->recv_mbuf, mgc->recv_mbuf.len);
     }
 }
 
+#endif
+
 void
 WPN114::Network::Server::
 on_connection(mg_connection *con)
 {
-    m_connections.emplace_back(con);
+    // closed slots are reused, along with their (emptied) subscriptions
+    for (auto& connection : m_connections) {
+        if (!connection.mgc()) {
+            connection = Connection(con, &m_outbox);
+            return;
+        }
+    }
+
+    m_connections.emplace_back(con, &m_outbox);
 }
 
 void
 WPN114::Network::Server::
 on_disconnection(mg_connection *connection)
 {
+    auto index = connection_index(connection);
+    if (index < 0)
+        return;
+
+    m_connections[index].close();
+    m_rate_limiter.remove_connection(index);
+
+    for (auto id : m_subscriptions.remove_connection(index))
+         if (auto node = m_tree.node(id))
+             node->set_observed(false);
+}
+
+int
+WPN114::Network::Server::
+connection_index(mg_connection* mgc) const
+{
+    for (int n = 0; n < int(m_connections.size()); ++n)
+         if (m_connections[n].mgc() == mgc)
+             return n;
 
+    return -1;
 }
 
 void
 WPN114::Network::Server::
 on_websocket_frame(mg_connection *mgc, websocket_message *message)
 {
-    QByteArray frame(
-                reinterpret_cast<const char*>(message->data),
-                message->size);
-
     if (message->flags & WEBSOCKET_OP_TEXT)
     {
+        QByteArray frame(
+                    reinterpret_cast<const char*>(message->data),
+                    message->size);
+
+        // the connection may not have been registered yet, or be gone already
+        auto index = connection_index(mgc);
+        if (index < 0)
+            return;
+
         // it would have to be json
-        auto doc = QJsonDocument::fromJson(frame);
-        auto obj = doc.object();
+        on_command(index, QJsonDocument::fromJson(frame).object());
 
-        auto command = obj["COMMAND"].toString();
+        emit websocketMessageReceived(frame);
+    }
 
-        Connection* sender = nullptr;
-        for (auto& connection : m_connections)
-            if (connection.mgc() == mgc)
-                sender = &connection;
+    else if (message->flags & WEBSOCKET_OP_BINARY) {
+        // it would have to be OSC
+        parse_osc(reinterpret_cast<const char*>(message->data), message->size);
+    }
+}
 
-        assert(sender);
+void
+WPN114::Network::Server::
+on_command(int index, QJsonObject const& obj)
+{
+    auto command = obj["COMMAND"].toString();
+    auto sender = &m_connections[index];
 
-        if (command == "LISTEN" || command == "IGNORE")
-        {
-            auto target = obj["DATA"].toString();
+    if (command == "LISTEN") {
+        // optional, in updates per second for all of the connection's listens, 0 lifts it
+        if (obj.contains("MAX_RATE"))
+            m_rate_limiter.set_rate(index, obj["MAX_RATE"].toDouble());
 
-            if (auto node = m_tree.find(target)) {
-                if (command == "LISTEN")
-                     QObject::connect(node, &Node::valueChanged, sender, &Connection::on_value_changed);
-                else QObject::disconnect(node, &Node::valueChanged, sender, &Connection::on_value_changed);
-            }
-        }
+        listen(index, obj["DATA"].toString());
+    }
 
-        else if (command == "START_OSC_STREAMING") {
-            uint16_t port = obj["DATA"].toObject()["LOCAL_SERVER_PORT"].toInt();
-            sender->set_udp(port);
+    else if (command == "IGNORE")
+        ignore(index, obj["DATA"].toString());
 
-            // at this point it is safe to validate the oscquery connection
-            // and send it back to qml
-            emit connection(*sender);
-        }
 
-        emit websocketMessageReceived(frame);
+    else if (command == "START_OSC_STREAMING") {
+        uint16_t port = obj["DATA"].toObject()["LOCAL_SERVER_PORT"].toInt();
+        sender->set_udp(port);
+
+        // at this point it is safe to validate the oscquery connection
+        // and send it back to qml
+        emit connection(*sender);
     }
+}
 
-    else if (message->flags & WEBSOCKET_OP_BINARY) {
-        // it would have to be OSC
-        OSCMessage oscmg(frame);
+void
+WPN114::Network::Server::
+serve_http_request(mg_connection* connection, http_message* request)
+{
+    // holding on to the snapshot keeps it alive, whatever the tree publishes in the meantime
+    auto snapshot = m_tree.published();
+
+    auto uri = std::string_view(request->uri.p, request->uri.len);
+    auto query = std::string_view(request->query_string.p, request->query_string.len);
+    auto& writers = m_http_responses.writers;
+
+    // chunked transfer encoding: the response goes out as it is being written
+    mg_send_head(connection, 200, -1, "Content-Type: application/json; charset=utf-8");
 
-        if (auto node = m_tree.find(oscmg.m_method))
-            node->set_value(oscmg.m_arguments);
+    if (query == "HOST_INFO")
+        writers.insert_or_assign(connection, JsonTreeWriter(m_host_info));
 
-        emit oscMessageReceived(oscmg);
+    else if (auto id = snapshot ? snapshot->find(uri) : 0)
+    {
+        if (query.empty()) {
+            // slice of the snapshot's document, which the writer shares rather than copies
+            auto range = snapshot->range(id);
+            writers.insert_or_assign(connection, JsonTreeWriter(snapshot->json(), range.begin, range.end));
+        }
+        else {
+            auto attribute = snapshot->attribute(id, QString::fromUtf8(query.data(), query.size()));
+            if  (attribute.isEmpty())
+                 writers.insert_or_assign(connection, JsonTreeWriter(QByteArrayLiteral("{}")));
+            else writers.insert_or_assign(connection, JsonTreeWriter(attribute));
+        }
     }
+
+    else writers.insert_or_assign(connection, JsonTreeWriter(QByteArrayLiteral("{}")));
+
+    write_http_chunks(connection);
+
+    // queued to the qt thread if anything is connected
+    if (isSignalConnected(QMetaMethod::fromSignal(&Server::httpRequestReceived)))
+        emit httpRequestReceived(QString::fromUtf8(uri.data(), uri.size())+
+                                 QString::fromUtf8(query.data(), query.size()));
 }
 
 void
 WPN114::Network::Server::
-on_http_request(mg_connection *connection, QString uri, QString query)
+write_http_chunks(mg_connection* connection)
 {
-    if (query == "HOST_INFO") {
-        QJsonDocument doc(info());
-        auto ba = doc.toJson(QJsonDocument::Compact);
-        mg_send_head(connection, 200, ba.count(), "Content-Type: application/json; charset=utf-8");
-        mg_send(connection, ba.data(), ba.count());
+    auto& writers = m_http_responses.writers;
+    auto response = writers.find(connection);
+    if (response == writers.end())
+        return;
+
+    auto& writer = response->second;
+    auto& chunk = m_http_responses.chunk;
+
+    while (!writer.done() && connection->send_mbuf.len < http_send_watermark)
+    {
+        chunk.resize(0);
+        writer.write(chunk, http_chunk_size);
+
+        if (!chunk.isEmpty())
+            mg_send_http_chunk(connection, chunk.constData(), chunk.size());
+    }
+
+    if (writer.done()) {
+        // empty chunk terminates the response
+        mg_send_http_chunk(connection, "", 0);
+        writers.erase(response);
     }
-    else
+}
+
+void
+WPN114::Network::Server::
+on_udp_messages()
+{
+    // cleared first: anything decoded from now on queues another call
+    m_udp_pending.store(false, std::memory_order_release);
+
+    while (auto message = m_udp_messages.front())
     {
-        // query root
-        QJsonDocument doc(m_tree.query(uri));
-        auto ba = doc.toJson(QJsonDocument::Compact);
-        mg_send_head(connection, 200, ba.count(), "Content-Type: application/json; charset=utf-8");
-        mg_send(connection, ba.data(), ba.count());
+        if (message->size <= UdpMessage::inline_size)
+            dispatch_osc(OSCView(message->data, message->size), message->timetag);
+        else {
+            dispatch_osc(OSCView(message->overflow.constData(), message->size), message->timetag);
+            message->overflow = QByteArray();
+        }
+
+        m_udp_messages.pop();
     }
+}
 
-    emit httpRequestReceived(uri+query);
+QVariantMap
+WPN114::Network::Server::
+udpStatistics() const
+{
+    qulonglong overflows = m_udp_overflows.load();
+
+#ifndef WPN114_UDP_BATCHING
+    // mongoose moves a single datagram per system call, and doesn't count them
+    return QVariantMap { { "overflows", overflows } };
+#else
+    auto& counters = m_udp.counters();
+
+    qulonglong
+    receive_calls   = counters.receive_calls.load(),
+    received        = counters.received.load(),
+    send_calls      = counters.send_calls.load(),
+    sent            = counters.sent.load(),
+    dropped         = counters.dropped.load();
+
+    return QVariantMap {
+        { "received", received },
+        { "receiveCalls", receive_calls },
+        { "receivedPerCall", receive_calls ? double(received)/receive_calls : 0. },
+        { "sent", sent },
+        { "sendCalls", send_calls },
+        { "sentPerCall", send_calls ? double(sent)/send_calls : 0. },
+        { "dropped", dropped },
+        { "overflows", overflows }
+    };
+#endif
 }
 
 void
 WPN114::Network::Server::
-on_udp_datagram(mg_connection *connection)
+on_osc_message(OSCView const& message)
 {
-    QByteArray cdg(
-               connection->recv_mbuf.buf,
-               connection->recv_mbuf.len);
+    NetworkDevice::on_osc_message(message);
 
-    OSCMessage msg(cdg);
-    emit oscMessageReceived(msg);
+    if (isSignalConnected(QMetaMethod::fromSignal(&Server::oscMessageReceived)))
+        emit oscMessageReceived(OSCMessage(message));
 }
 
 QJsonObject const
@@ -250,6 +451,211 @@ info() const
     return info;
 }
 
+void
+WPN114::Network::Server::
+on_value_changed(Node& node)
+{
+    auto const& subscribers = m_subscriptions.subscribers(node.id());
+    if (subscribers.isEmpty())
+        return;
+
+    QByteArray* packet = nullptr;
+    auto now = m_clock.elapsed();
+
+    for (auto index : subscribers)
+    {
+        if (m_rate_limiter.limited(index)) {
+            // only the node is kept, its value is read when the connection is flushed
+            schedule_flush(m_rate_limiter.defer(index, node.id(), now));
+            continue;
+        }
+
+        if (!packet) {
+            // encoded once, then copied into each subscriber's pooled outbox buffer
+            auto flags = node.type() == Type::Double ? OSCEncoder::DoublePrecision : 0;
+            auto& address = node.address();
+
+            packet = &OSCEncoder::encode(OSCEncoder::local_buffer(),
+                      std::string_view(address.constData(), address.size()),
+                      node.typed_value(), flags);
+        }
+
+        m_connections[index].send(*packet, node.critical());
+    }
+}
+
+void
+WPN114::Network::Server::
+schedule_flush(int64_t deadline)
+{
+    if (deadline < 0 || (m_flush_deadline >= 0 && m_flush_deadline <= deadline))
+        return;
+
+    m_flush_deadline = deadline;
+    m_flush_timer.start(std::max<int64_t>(0, deadline-m_clock.elapsed()));
+}
+
+void
+WPN114::Network::Server::
+on_flush_timeout()
+{
+    m_flush_deadline = -1;
+
+    auto next = m_rate_limiter.flush(m_clock.elapsed(),
+                [this](uint32_t connection, QVector<uint32_t> const& nodes) {
+                    flush(connection, nodes);
+                });
+
+    schedule_flush(next);
+}
+
+void
+WPN114::Network::Server::
+flush(uint32_t connection, QVector<uint32_t> const& nodes)
+{
+    auto const& subscriptions = m_subscriptions.subscriptions(connection);
+    auto& target = m_connections[connection];
+
+    // copied into the outbox as they are sent
+    QByteArray critical, datagrams;
+    OSCBundleWriter critical_bundle(critical), bundle(datagrams);
+
+    for (auto id : nodes)
+    {
+        // the node may have been removed or ignored in the meantime
+        auto node = m_tree.node(id);
+        if (!node || !std::binary_search(subscriptions.begin(), subscriptions.end(), id))
+            continue;
+
+        auto flags = node->type() == Type::Double ? OSCEncoder::DoublePrecision : 0;
+        auto& address = node->address();
+        std::string_view path(address.constData(), address.size());
+
+        if (node->critical()) {
+            critical_bundle.append(path, node->typed_value(), flags);
+            continue;
+        }
+
+        auto mark = datagrams.size();
+        bundle.append(path, node->typed_value(), flags);
+
+        if (datagrams.size() > Connection::max_datagram_size && bundle.count() > 1) {
+            // doesn't fit: send what we have and start over with this node
+            datagrams.resize(mark);
+            target.send(datagrams, false);
+            bundle.reset();
+            bundle.append(path, node->typed_value(), flags);
+        }
+    }
+
+    if (bundle.count())
+        target.send(datagrams, false);
+
+    if (critical_bundle.count())
+        target.send(critical, true);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+static void
+collect(Node* node, QVector<Node*>& nodes)
+// node and everything below it
+{
+    nodes << node;
+    for (const auto& subnode : node->subnodes())
+         collect(subnode, nodes);
+}
+
+QVector<Node*>
+WPN114::Network::Server::
+resolve(Subscriptions::Rule const& rule)
+{
+    QVector<Node*> nodes;
+
+    switch (rule.kind)
+    {
+    case Subscriptions::Rule::Path:
+    {
+        if (auto node = m_tree.find(rule.target))
+            nodes << node;
+        break;
+    }
+    case Subscriptions::Rule::Subtree:
+    {
+        auto root = rule.prefix.isEmpty() ? m_tree.root() : m_tree.find(rule.prefix);
+        if (root)
+            collect(root, nodes);
+        break;
+    }
+    case Subscriptions::Rule::Pattern:
+        nodes = m_tree.match(rule.target);
+    }
+
+    return nodes;
+}
+
+void
+WPN114::Network::Server::
+listen(uint32_t connection, QString const& target)
+{
+    if (!m_subscriptions.add_rule(connection, target))
+        return;
+
+    // resolved once here, then kept up to date as nodes are added or removed
+    for (const auto& node : resolve(m_subscriptions.rules().last())) {
+         m_subscriptions.subscribe(node->id(), connection);
+         node->set_observed(true);
+    }
+}
+
+void
+WPN114::Network::Server::
+ignore(uint32_t connection, QString const& target)
+{
+    auto nodes = resolve(Subscriptions::Rule(connection, target));
+
+    if (!m_subscriptions.remove_rule(connection, target))
+        return;
+
+    // nodes may still be covered by another of the connection's rules
+    for (const auto& node : nodes)
+         if (!m_subscriptions.covered(connection, node->path()) &&
+              m_subscriptions.unsubscribe(node->id(), connection))
+              node->set_observed(false);
+}
+
+void
+WPN114::Network::Server::
+on_subtree_added(Node& node)
+{
+    if (m_subscriptions.rules().isEmpty())
+        return;
+
+    // added nodes come with their own subnodes
+    QVector<Node*> nodes;
+    collect(&node, nodes);
+
+    for (const auto& rule : m_subscriptions.rules())
+         for (const auto& added : nodes)
+              if (rule.covers(added->path())) {
+                  m_subscriptions.subscribe(added->id(), rule.connection);
+                  added->set_observed(true);
+              }
+}
+
+void
+WPN114::Network::Server::
+on_subtree_removed(Node& node)
+{
+    QVector<Node*> nodes;
+    collect(&node, nodes);
+
+    for (const auto& removed : nodes) {
+         m_subscriptions.remove_node(removed->id());
+         removed->set_observed(false);
+    }
+}
+
 void
 WPN114::Network::Server::
 on_node_added(Node* node)
@@ -262,8 +668,12 @@ on_node_added(Node* node)
     data.insert(node->name(), static_cast<QJsonObject>(*node));
     command.insert("DATA", data);
 
+    // serialized once for everyone
+    auto json = QJsonDocument(command).toJson(QJsonDocument::Compact);
+
     for (auto& connection : m_connections)
-        connection.writeJson(command);
+         if (connection.mgc())
+             connection.write_json(json);
 }
 
 
@@ -278,6 +688,9 @@ on_node_removed(Node* node)
     command.insert("COMMAND", "PATH_REMOVED");
     command.insert("DATA", node->path());
 
+    auto json = QJsonDocument(command).toJson(QJsonDocument::Compact);
+
     for (auto& connection : m_connections)
-        connection.writeJson(command);
+         if (connection.mgc())
+             connection.write_json(json);
 }
@@ -2,7 +2,16 @@
 
 #include "network.hpp"
 #include "osc.hpp"
+#include "json.hpp"
+#include "udp.hpp"
+#include "ring.hpp"
+#include "subscriptions.hpp"
+#include "ratelimit.hpp"
+#include <QTimer>
+#include <QElapsedTimer>
 #include <thread>
+#include <atomic>
+#include <unordered_map>
 
 namespace WPN114   {
 namespace Network  {
@@ -32,7 +41,7 @@ ServerExtensions =
 };
 
 //=================================================================================================
-class Server : public NetworkDevice
+class Server : public NetworkDevice, public TreeObserver
 //=================================================================================================
 {
     Q_OBJECT
@@ -83,12 +92,27 @@ public:
     void
     server_poll();
 
+#ifdef WPN114_UDP_BATCHING
+    void
+    udp_poll();
+    // receives osc datagrams on a thread of its own, in batches.
+    // mongoose reads any socket it polls by itself before calling its handler,
+    // so the batched socket can't share m_mgr without losing datagram boundaries
+#endif
+
+    void
+    queue_udp_datagram(const char* data, size_t size);
+    // network or udp thread: decodes a datagram into m_udp_messages
+
     //-------------------------------------------------------------------------------------------------
     static void
     ws_event_handler(mg_connection* mgc, int event, void* data);
 
+#ifndef WPN114_UDP_BATCHING
     static void
     udp_event_handler(mg_connection* mgc, int event, void* data);
+#endif
+
 
     //-------------------------------------------------------------------------------------------------
     Q_INVOKABLE void
@@ -101,19 +125,52 @@ public:
 
     //-------------------------------------------------------------------------------------------------
 
-    Q_INVOKABLE void
-    on_http_request(mg_connection* connection, QString uri, QString query);
+    void
+    serve_http_request(mg_connection* connection, http_message* request);
+    // answers namespace and attribute queries on the network thread,
+    // from the tree's published snapshot
 
     Q_INVOKABLE void
     on_websocket_frame(mg_connection* mgc, websocket_message* message);
 
+    void
+    on_command(int index, QJsonObject const& command);
+    // a single json command, one per text frame
+
     Q_INVOKABLE void
-    on_udp_datagram(mg_connection* connection);
+    on_udp_messages();
+    // drains everything decoded so far, invoked once per event loop turn at most
+
+    //-------------------------------------------------------------------------------------------------
+    Q_INVOKABLE QVariantMap
+    udpStatistics() const;
+    // datagrams received and sent, along with how many each system call moved on average
+
+    //-------------------------------------------------------------------------------------------------
+    virtual void
+    on_osc_message(OSCView const& message) override;
 
     //-------------------------------------------------------------------------------------------------
     QJsonObject const
     info() const;
 
+    //-------------------------------------------------------------------------------------------------
+    void
+    on_value_changed(Node& node) override;
+    // encodes the node's value once, for all of its listeners.
+    // rate-limited listeners get it on their next flush instead
+
+    void
+    on_subtree_added(Node& node) override;
+    // subscribes the new nodes to every rule that covers them
+
+    void
+    on_subtree_removed(Node& node) override;
+
+    Q_SLOT void
+    on_flush_timeout();
+    // sends rate-limited listeners the latest values of what changed since their last flush
+
     //-------------------------------------------------------------------------------------------------
     Q_SLOT void
     on_node_added(Node* node);
@@ -167,16 +224,121 @@ public:
 
 private:
 
+    //-------------------------------------------------------------------------------------------------
+    struct HttpResponses
+    {
+        std::unordered_map<mg_connection*, JsonTreeWriter>
+        writers;
+
+        QByteArray
+        chunk;
+    };
+
+    void
+    write_http_chunks(mg_connection* connection);
+    // network thread only
+
+    static constexpr int
+    http_chunk_size = 4096,
+    http_send_watermark = 65536;
+    // responses are written in chunks until this much is waiting in the connection's send buffer
+
+    QVector<Node*>
+    resolve(Subscriptions::Rule const& rule);
+
+    void
+    listen(uint32_t connection, QString const& target);
+
+    void
+    flush(uint32_t connection, QVector<uint32_t> const& nodes);
+    // one bundle for critical nodes, as few datagrams as possible for the others
+
+    void
+    schedule_flush(int64_t deadline);
+
+    void
+    ignore(uint32_t connection, QString const& target);
+
+    int
+    connection_index(mg_connection* mgc) const;
+    // open connection for 'mgc', or -1
+
     std::vector<Connection>
     m_connections;
+    // indexes are used as connection ids: closed entries stay in place, until a new
+    // connection takes their slot, so that it only grows with the number of simultaneous ones
 
-    mg_connection
-    *m_tcp_connection = nullptr,
-    *m_udp_connection = nullptr;
+    Subscriptions
+    m_subscriptions;
 
-    mg_mgr
-    m_tcp,
+    RateLimiter
+    m_rate_limiter;
+
+    QTimer
+    m_flush_timer;
+
+    QElapsedTimer
+    m_clock;
+
+    int64_t
+    m_flush_deadline = -1;
+    // what m_flush_timer is set for, -1 if it isn't
+
+    HttpResponses
+    m_http_responses;
+    // pending responses, network thread only
+
+    QByteArray
+    m_host_info;
+    // set before the network thread starts
+
+    mg_connection*
+    m_tcp_connection = nullptr;
+
+#ifdef WPN114_UDP_BATCHING
+    UdpSocket
     m_udp;
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    struct UdpMessage
+    // a single message, out of its datagram or bundle
+    {
+        static constexpr size_t
+        inline_size = 512;
+
+        uint64_t
+        timetag = 0;
+
+        size_t
+        size = 0;
+
+        char
+        data[inline_size];
+
+        QByteArray
+        overflow;
+        // for messages that don't fit inline
+    };
+
+    SPSCRing<UdpMessage, 2048>
+    m_udp_messages;
+
+    std::atomic<bool>
+    m_udp_pending { false };
+
+    std::atomic<uint64_t>
+    m_udp_overflows { 0 };
+    // messages dropped because the qt thread couldn't keep up
+
+    mg_mgr
+    m_mgr;
+    // tcp (and, without batched udp, udp) listeners share a single manager,
+    // polled as one set of sockets
+
+    static constexpr int
+    poll_timeout = 200;
+    // readiness on any socket ends a poll early, this only bounds how long stop() may wait
 
     uint16_t
     m_tcp_port = 5678,
@@ -185,8 +347,13 @@ private:
     std::thread
     m_mgthread;
 
-    bool
-    m_running = false;
+#ifdef WPN114_UDP_BATCHING
+    std::thread
+    m_udpthread;
+#endif
+
+    std::atomic<bool>
+    m_running { false };
 
     QString
     m_name = "wpn114";
@@ -0,0 +1,116 @@
+#include "snapshot.hpp"
+#include "tree.hpp"
+#include <QJsonDocument>
+#include <QJsonObject>
+
+using namespace WPN114::Network;
+
+static constexpr int
+contents_key = sizeof(",\"CONTENTS\":{")-1;
+// what append_json_head writes after the attributes
+
+static int
+skip_json_string(QByteArray const& json, int offset)
+// offset of the first byte after the quoted string starting at 'offset'
+{
+    for (auto n = offset+1; n < json.size(); ++n) {
+        if (json[n] == '\\')
+            ++n;
+        else if (json[n] == '"')
+            return n+1;
+    }
+
+    return json.size();
+}
+
+WPN114::Network::NamespaceSnapshot::Index::
+Index(std::unordered_map<std::string_view, uint32_t> const& paths)
+{
+    size_t size = 0;
+    for (const auto& entry : paths)
+         size += entry.first.size();
+
+    // reserved up front: the keys can't be taken before the storage stops growing
+    storage.reserve(size);
+    for (const auto& entry : paths)
+         storage.append(entry.first);
+
+    ids.reserve(paths.size());
+    size_t offset = 0;
+
+    for (const auto& entry : paths) {
+         ids.emplace(std::string_view(storage.data()+offset, entry.first.size()), entry.second);
+         offset += entry.first.size();
+    }
+}
+
+WPN114::Network::NamespaceSnapshot::
+NamespaceSnapshot(Node const& root, std::shared_ptr<const Index> index, uint64_t structure) :
+    m_json(root.json()), m_index(std::move(index)), m_structure(structure)
+{
+    locate(root, 0);
+}
+
+void
+WPN114::Network::NamespaceSnapshot::
+locate(Node const& node, int offset)
+// walks the tree along the cached json, nothing is serialized here
+{
+    auto const& json = node.json();
+
+    if (node.id() >= m_ranges.size())
+        m_ranges.resize(node.id()+1);
+
+    auto& range = m_ranges[node.id()];
+    range.begin = offset;
+    range.attributes = offset+node.json_head()-contents_key;
+    range.end = offset+json.size();
+
+    // its subnodes are either all loaded, or all serialized from their records
+    if (!node.expanded() && node.tree())
+        node.tree()->locate_records(node.id(), offset, m_ranges);
+
+    offset += node.json_head();
+    auto const& subnodes = node.loaded_subnodes();
+
+    for (int n = 0; n < subnodes.count(); ++n)
+    {
+        if (n) ++offset;
+        // name, then ':'
+        offset = skip_json_string(m_json, offset)+1;
+        locate(*subnodes[n], offset);
+        offset += subnodes[n]->json().size();
+    }
+}
+
+uint32_t
+WPN114::Network::NamespaceSnapshot::
+find(std::string_view address) const
+{
+    if (!m_index)
+        return 0;
+
+    auto it = m_index->ids.find(address);
+    if  (it == m_index->ids.end() || it->second >= m_ranges.size())
+         return 0;
+    else return m_ranges[it->second].end ? it->second : 0;
+}
+
+QByteArray
+WPN114::Network::NamespaceSnapshot::
+attribute(uint32_t id, QString const& attribute) const
+{
+    auto range = this->range(id);
+    if (!range.end)
+        return QByteArray();
+
+    auto attributes = m_json.mid(range.begin, range.attributes-range.begin);
+    attributes.append('}');
+
+    auto object = QJsonDocument::fromJson(attributes).object();
+    if (!object.contains(attribute))
+        return QByteArray();
+
+    QJsonObject result { { attribute, object[attribute] } };
+    return QJsonDocument(result).toJson(QJsonDocument::Compact);
+}
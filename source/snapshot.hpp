@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace WPN114  {
+namespace Network {
+
+class Node;
+
+//=================================================================================================
+class NamespaceSnapshot
+//=================================================================================================
+// immutable copy of the tree's namespace, published by the tree's thread and read by the
+// network thread without locking: the whole namespace is held as a single json document,
+// every node (or mirrored record) being a contiguous slice of it. readers keep the snapshot
+// they loaded alive for as long as they need it, the next one being swapped in atomically
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    struct Range
+    {
+        int
+        begin = 0,
+        attributes = 0,
+        end = 0;
+        // node's json is [begin, end), its attributes object [begin, attributes) + '}'
+    };
+
+    struct Index
+    // full utf8 path -> id, shared between snapshots as long as the tree structure doesn't change
+    {
+        Index(std::unordered_map<std::string_view, uint32_t> const& paths);
+        // copies the paths into its own storage, which the keys then point into
+
+        Index(Index const&) = delete;
+
+        std::string
+        storage;
+
+        std::unordered_map<std::string_view, uint32_t>
+        ids;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    NamespaceSnapshot(Node const& root, std::shared_ptr<const Index> index, uint64_t structure);
+    // root's json has to be up to date
+
+    //---------------------------------------------------------------------------------------------
+    uint64_t
+    structure() const { return m_structure; }
+
+    std::shared_ptr<const Index> const&
+    index() const { return m_index; }
+
+    //---------------------------------------------------------------------------------------------
+    uint32_t
+    find(std::string_view address) const;
+    // 0 if not found
+
+    QByteArray const&
+    json() const { return m_json; }
+
+    Range
+    range(uint32_t id) const { return id < m_ranges.size() ? m_ranges[id] : Range(); }
+
+    //---------------------------------------------------------------------------------------------
+    QByteArray
+    attribute(uint32_t id, QString const& attribute) const;
+    // '{"ATTRIBUTE":value}', or an empty array if the node doesn't have it
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    void
+    locate(Node const& node, int offset);
+
+    //---------------------------------------------------------------------------------------------
+    QByteArray
+    m_json;
+
+    std::vector<Range>
+    m_ranges;
+    // id -> slice of m_json
+
+    std::shared_ptr<const Index>
+    m_index;
+
+    uint64_t
+    m_structure = 0;
+};
+
+}
+}
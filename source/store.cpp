@@ -0,0 +1,230 @@
+#include "store.hpp"
+#include <algorithm>
+#include <type_traits>
+
+using namespace WPN114::Network;
+
+template<typename _Column> static uint32_t
+append(_Column& column, uint32_t id)
+{
+    column.ids.push_back(id);
+    column.values.resize(column.values.size()+_Column::width);
+    return column.size()-1;
+}
+
+template<typename _T, typename _V> static bool
+assign(_T& dst, _V value)
+{
+    auto src = static_cast<_T>(value);
+    if (dst == src)
+        return false;
+
+    dst = src;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool
+WPN114::Network::ValueStore::
+stores(Type::Values type)
+{
+    switch (type)
+    {
+    case Type::Int:
+    case Type::Float:
+    case Type::Bool:
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:   return true;
+    default:            return false;
+    }
+}
+
+void
+WPN114::Network::ValueStore::
+insert(uint32_t id, Type::Values type)
+{
+    if (!stores(type))
+        return;
+
+    if (contains(id))
+        remove(id);
+
+    if (id >= m_slots.size())
+        m_slots.resize(id+1);
+
+    auto& slot = m_slots[id];
+    slot.type = type;
+
+    switch (type)
+    {
+    case Type::Int:     slot.kind = Kind::Int;      slot.index = append(m_ints, id);    break;
+    case Type::Float:   slot.kind = Kind::Float;    slot.index = append(m_floats, id);  break;
+    case Type::Bool:    slot.kind = Kind::Bool;     slot.index = append(m_bools, id);   break;
+    default:            slot.kind = Kind::Vec;      slot.index = append(m_vecs, id);
+    }
+
+    ++m_layout;
+}
+
+template<typename _Column> void
+WPN114::Network::ValueStore::
+erase(_Column& column, uint32_t slot)
+// moves the last slot into the erased one
+{
+    auto last = column.size()-1;
+
+    if (slot != last) {
+        std::copy(column.at(last), column.at(last)+_Column::width, column.at(slot));
+        column.ids[slot] = column.ids[last];
+        m_slots[column.ids[slot]].index = slot;
+    }
+
+    column.ids.pop_back();
+    column.values.resize(column.values.size()-_Column::width);
+}
+
+void
+WPN114::Network::ValueStore::
+remove(uint32_t id)
+{
+    if (!contains(id))
+        return;
+
+    auto& slot = m_slots[id];
+
+    switch (slot.kind)
+    {
+    case Kind::Int:     erase(m_ints, slot.index);      break;
+    case Kind::Float:   erase(m_floats, slot.index);    break;
+    case Kind::Bool:    erase(m_bools, slot.index);     break;
+    case Kind::Vec:     erase(m_vecs, slot.index);      break;
+    case Kind::None:    break;
+    }
+
+    slot = Slot();
+    ++m_layout;
+}
+
+Value
+WPN114::Network::ValueStore::
+value(uint32_t id) const
+{
+    if (!contains(id))
+        return Value();
+
+    auto& slot = m_slots[id];
+
+    switch (slot.kind)
+    {
+    case Kind::Int:     return Value(*m_ints.at(slot.index));
+    case Kind::Float:   return Value(*m_floats.at(slot.index));
+    case Kind::Bool:    return Value(static_cast<bool>(*m_bools.at(slot.index)));
+    case Kind::Vec:
+    {
+        auto width = slot.type == Type::Vec2f ? 2 : slot.type == Type::Vec3f ? 3 : 4;
+        return Value::vec(m_vecs.at(slot.index), width);
+    }
+    default:            return Value();
+    }
+}
+
+bool
+WPN114::Network::ValueStore::
+set_value(uint32_t id, Value const& value)
+{
+    if (!contains(id))
+        return false;
+
+    auto& slot = m_slots[id];
+
+    switch (slot.kind)
+    {
+    case Kind::Int:     return assign(*m_ints.at(slot.index), value.to_int());
+    case Kind::Float:   return assign(*m_floats.at(slot.index), value.to_float());
+    case Kind::Bool:    return assign(*m_bools.at(slot.index), value.to_bool());
+    case Kind::Vec:
+    {
+        float vec[4] = { 0.f, 0.f, 0.f, 0.f };
+
+        if  (value.width() > 1)
+             std::copy(value.vec(), value.vec()+4, vec);
+        else vec[0] = value.to_float();
+
+        auto dst = m_vecs.at(slot.index);
+        if (std::equal(vec, vec+4, dst))
+            return false;
+
+        std::copy(vec, vec+4, dst);
+        return true;
+    }
+    default:            return false;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template<typename _Current, typename _Column> void
+WPN114::Network::ValueStore::
+compare(_Current& current, _Column const& snapshot, Kind kind,
+        bool same_layout, bool write, QVector<uint32_t>& changed) const
+{
+    constexpr int width = _Column::width;
+
+    for (uint32_t n = 0; n < snapshot.size(); ++n)
+    {
+        auto id = snapshot.ids[n];
+        auto slot = n;
+
+        if (!same_layout) {
+            // slots have moved since the snapshot: look each node up
+            if (id >= m_slots.size() || m_slots[id].kind != kind)
+                continue;
+            slot = m_slots[id].index;
+        }
+
+        auto src = snapshot.at(n);
+        auto dst = current.at(slot);
+
+        if (std::equal(src, src+width, dst))
+            continue;
+
+        if constexpr (!std::is_const<_Current>::value) {
+            if (write)
+                std::copy(src, src+width, dst);
+        }
+
+        changed << id;
+    }
+}
+
+QVector<uint32_t>
+WPN114::Network::ValueStore::
+diff(Snapshot const& snapshot) const
+{
+    QVector<uint32_t> changed;
+    auto same = snapshot.layout == m_layout;
+
+    compare(m_ints, snapshot.ints, Kind::Int, same, false, changed);
+    compare(m_floats, snapshot.floats, Kind::Float, same, false, changed);
+    compare(m_bools, snapshot.bools, Kind::Bool, same, false, changed);
+    compare(m_vecs, snapshot.vecs, Kind::Vec, same, false, changed);
+
+    return changed;
+}
+
+QVector<uint32_t>
+WPN114::Network::ValueStore::
+recall(Snapshot const& snapshot)
+{
+    QVector<uint32_t> changed;
+    auto same = snapshot.layout == m_layout;
+
+    compare(m_ints, snapshot.ints, Kind::Int, same, true, changed);
+    compare(m_floats, snapshot.floats, Kind::Float, same, true, changed);
+    compare(m_bools, snapshot.bools, Kind::Bool, same, true, changed);
+    compare(m_vecs, snapshot.vecs, Kind::Vec, same, true, changed);
+
+    return changed;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "node.hpp"
+#include <vector>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+class ValueStore
+//=================================================================================================
+// struct-of-arrays storage for the values of Int, Float, Bool and Vec2f/3f/4f nodes:
+// each kind of value has its own contiguous array, along with the id of the node owning each slot.
+// snapshots, recalls and change detection are linear scans over these arrays
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    template<typename _T, int _Width>
+    struct Column
+    //---------------------------------------------------------------------------------------------
+    {
+        static constexpr int
+        width = _Width;
+
+        std::vector<_T>
+        values;
+        // _Width values per slot
+
+        std::vector<uint32_t>
+        ids;
+        // slot -> node id
+
+        size_t
+        size() const { return ids.size(); }
+
+        _T*
+        at(uint32_t slot) { return values.data()+slot*_Width; }
+
+        const _T*
+        at(uint32_t slot) const { return values.data()+slot*_Width; }
+    };
+
+    using Ints      = Column<int32_t, 1>;
+    using Floats    = Column<float, 1>;
+    using Bools     = Column<uint8_t, 1>;
+    using Vecs      = Column<float, 4>;
+    // Vec2f and Vec3f leave their trailing lanes to zero
+
+    //---------------------------------------------------------------------------------------------
+    struct Snapshot
+    //---------------------------------------------------------------------------------------------
+    {
+        Ints
+        ints;
+
+        Floats
+        floats;
+
+        Bools
+        bools;
+
+        Vecs
+        vecs;
+
+        uint64_t
+        layout = 0;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    static bool
+    stores(Type::Values type);
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    contains(uint32_t id) const { return id < m_slots.size() && m_slots[id].kind != Kind::None; }
+
+    Type::Values
+    type(uint32_t id) const { return contains(id) ? m_slots[id].type : Type::None; }
+
+    //---------------------------------------------------------------------------------------------
+    void
+    insert(uint32_t id, Type::Values type);
+    // allocates a zeroed slot for node 'id'
+
+    void
+    remove(uint32_t id);
+
+    //---------------------------------------------------------------------------------------------
+    Value
+    value(uint32_t id) const;
+
+    bool
+    set_value(uint32_t id, Value const& value);
+    // returns false if value didn't change
+
+    //---------------------------------------------------------------------------------------------
+    Snapshot
+    snapshot() const { return Snapshot { m_ints, m_floats, m_bools, m_vecs, m_layout }; }
+
+    QVector<uint32_t>
+    diff(Snapshot const& snapshot) const;
+    // ids of the nodes whose value differs from 'snapshot'
+
+    QVector<uint32_t>
+    recall(Snapshot const& snapshot);
+    // restores values from 'snapshot', returning the ids of the nodes that changed
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    enum class Kind : uint8_t { None, Int, Float, Bool, Vec };
+
+    struct Slot
+    {
+        Kind
+        kind = Kind::None;
+
+        Type::Values
+        type = Type::None;
+
+        uint32_t
+        index = 0;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    template<typename _Current, typename _Column> void
+    compare(_Current& current, _Column const& snapshot, Kind kind,
+            bool same_layout, bool write, QVector<uint32_t>& changed) const;
+
+    template<typename _Column> void
+    erase(_Column& column, uint32_t slot);
+
+    //---------------------------------------------------------------------------------------------
+    std::vector<Slot>
+    m_slots;
+    // node id -> slot
+
+    Ints
+    m_ints;
+
+    Floats
+    m_floats;
+
+    Bools
+    m_bools;
+
+    Vecs
+    m_vecs;
+
+    uint64_t
+    m_layout = 0;
+    // bumped whenever slots are added or moved: snapshots taken with the same layout
+    // can be compared slot by slot, others have to go through the id -> slot mapping
+};
+
+}
+}
@@ -0,0 +1,170 @@
+#include "subscriptions.hpp"
+#include <algorithm>
+
+using namespace WPN114::Network;
+
+static bool
+insert_sorted(QVector<uint32_t>& vector, uint32_t value)
+{
+    auto it = std::lower_bound(vector.begin(), vector.end(), value);
+    if (it != vector.end() && *it == value)
+        return false;
+
+    vector.insert(it, value);
+    return true;
+}
+
+static bool
+remove_sorted(QVector<uint32_t>& vector, uint32_t value)
+{
+    auto it = std::lower_bound(vector.begin(), vector.end(), value);
+    if (it == vector.end() || *it != value)
+        return false;
+
+    vector.erase(it);
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WPN114::Network::Subscriptions::Rule::
+Rule(uint32_t connection, QString const& target) :
+    connection(connection), target(target)
+{
+    if (OSCPattern::is_pattern(target)) {
+        kind = Pattern;
+        pattern = OSCPattern(target);
+    }
+    else if (target.endsWith('/')) {
+        kind = Subtree;
+        prefix = target.left(target.size()-1);
+    }
+}
+
+bool
+WPN114::Network::Subscriptions::Rule::
+covers(QString const& path) const
+{
+    switch (kind)
+    {
+    case Path:      return path == target;
+    case Pattern:   return pattern.matches(path);
+    case Subtree:   return path.startsWith(prefix) &&
+                          (path.size() == prefix.size() || path[prefix.size()] == '/');
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool
+WPN114::Network::Subscriptions::
+add_rule(uint32_t connection, QString const& target)
+{
+    for (const auto& rule : m_rules)
+         if (rule.connection == connection && rule.target == target)
+             return false;
+
+    m_rules << Rule(connection, target);
+    return true;
+}
+
+bool
+WPN114::Network::Subscriptions::
+remove_rule(uint32_t connection, QString const& target)
+{
+    for (int n = 0; n < m_rules.size(); ++n) {
+        if (m_rules[n].connection == connection && m_rules[n].target == target) {
+            m_rules.remove(n);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+WPN114::Network::Subscriptions::
+covered(uint32_t connection, QString const& path) const
+{
+    for (const auto& rule : m_rules)
+         if (rule.connection == connection && rule.covers(path))
+             return true;
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool
+WPN114::Network::Subscriptions::
+subscribe(uint32_t node, uint32_t connection)
+{
+    if (node >= m_subscribers.size())
+        m_subscribers.resize(node+1);
+
+    if (connection >= m_subscriptions.size())
+        m_subscriptions.resize(connection+1);
+
+    auto& subscribers = m_subscribers[node];
+    auto first = subscribers.isEmpty();
+
+    if (insert_sorted(subscribers, connection))
+        insert_sorted(m_subscriptions[connection], node);
+
+    return first;
+}
+
+bool
+WPN114::Network::Subscriptions::
+unsubscribe(uint32_t node, uint32_t connection)
+{
+    if (node >= m_subscribers.size() || connection >= m_subscriptions.size())
+        return false;
+
+    auto& subscribers = m_subscribers[node];
+
+    if (!remove_sorted(subscribers, connection))
+        return false;
+
+    remove_sorted(m_subscriptions[connection], node);
+    return subscribers.isEmpty();
+}
+
+QVector<uint32_t>
+WPN114::Network::Subscriptions::
+remove_connection(uint32_t connection)
+{
+    QVector<uint32_t> orphans;
+
+    for (int n = m_rules.size()-1; n >= 0; --n)
+         if (m_rules[n].connection == connection)
+             m_rules.remove(n);
+
+    if (connection >= m_subscriptions.size())
+        return orphans;
+
+    for (auto node : m_subscriptions[connection]) {
+        auto& subscribers = m_subscribers[node];
+        remove_sorted(subscribers, connection);
+        if (subscribers.isEmpty())
+            orphans << node;
+    }
+
+    m_subscriptions[connection].clear();
+    return orphans;
+}
+
+void
+WPN114::Network::Subscriptions::
+remove_node(uint32_t node)
+{
+    if (node >= m_subscribers.size())
+        return;
+
+    for (auto connection : m_subscribers[node])
+         remove_sorted(m_subscriptions[connection], node);
+
+    m_subscribers[node].clear();
+}
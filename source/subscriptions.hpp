@@ -0,0 +1,115 @@
+#pragma once
+
+#include <QVector>
+#include <QString>
+#include <vector>
+#include <cstdint>
+
+#include "pattern.hpp"
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+class Subscriptions
+//=================================================================================================
+// which connections listen to which nodes, both by id: each node holds a small sorted
+// vector of subscribers, so that a value change is encoded once and sent to each of them.
+// the rules these subscriptions were resolved from are kept as well, for nodes added later on
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    struct Rule
+    //---------------------------------------------------------------------------------------------
+    {
+        enum Kind { Path, Subtree, Pattern };
+
+        Rule() {}
+
+        Rule(uint32_t connection, QString const& target);
+        // a path, a path ending with '/' for the whole subtree below it, or an OSC pattern
+
+        bool
+        covers(QString const& path) const;
+
+        uint32_t
+        connection = 0;
+
+        Kind
+        kind = Path;
+
+        QString
+        target,
+        prefix;
+        // subtree path, without its trailing '/'
+
+        OSCPattern
+        pattern;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    add_rule(uint32_t connection, QString const& target);
+    // returns false if the connection already listens to 'target'
+
+    bool
+    remove_rule(uint32_t connection, QString const& target);
+
+    bool
+    covered(uint32_t connection, QString const& path) const;
+    // true if any of the connection's rules covers 'path'
+
+    QVector<Rule> const&
+    rules() const { return m_rules; }
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    subscribe(uint32_t node, uint32_t connection);
+    // returns true if 'node' had no subscribers before
+
+    bool
+    unsubscribe(uint32_t node, uint32_t connection);
+    // returns true if 'node' has no subscribers left
+
+    //---------------------------------------------------------------------------------------------
+    QVector<uint32_t>
+    remove_connection(uint32_t connection);
+    // drops all of the connection's subscriptions and rules,
+    // returns the nodes that are left without any subscriber
+
+    void
+    remove_node(uint32_t node);
+
+    //---------------------------------------------------------------------------------------------
+    QVector<uint32_t> const&
+    subscribers(uint32_t node) const
+    {
+        static const QVector<uint32_t> none;
+        return node < m_subscribers.size() ? m_subscribers[node] : none;
+    }
+
+    QVector<uint32_t> const&
+    subscriptions(uint32_t connection) const
+    {
+        static const QVector<uint32_t> none;
+        return connection < m_subscriptions.size() ? m_subscriptions[connection] : none;
+    }
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    std::vector<QVector<uint32_t>>
+    m_subscribers;
+    // node id -> connections
+
+    std::vector<QVector<uint32_t>>
+    m_subscriptions;
+    // connection -> node ids, so that closing a connection doesn't have to scan every node
+
+    QVector<Rule>
+    m_rules;
+};
+
+}
+}
@@ -1,4 +1,7 @@
 #include "tree.hpp"
+#include "json.hpp"
+#include <QElapsedTimer>
+#include <QJsonDocument>
 
 using namespace WPN114::Network;
 
@@ -112,9 +115,14 @@ link(Node* node)
     {
         auto parent = dup->parent_node();
 
-        for (auto subnode : dup->subnodes())
-             node->add_subnode(subnode);
+        // hand dup's children over to the new node
+        for (auto subnode : dup->subnodes()) {
+             subnode->set_parent_node(node);
+             node->subnodes().push_back(subnode);
+        }
 
+        dup->subnodes().clear();
+        node->invalidate_json();
         parent->remove_subnode(dup);
         parent->add_subnode(node);
         delete dup;
@@ -130,22 +138,82 @@ Node*
 WPN114::Network::Tree::
 find(QString path)
 {
-    if (path == "/" || path.isEmpty())
+    if (path.isEmpty())
         return &m_root;
 
-    auto split = path.split('/');
-    split.removeFirst();
+    auto address = path.toUtf8();
+    return find(std::string_view(address.constData(), address.size()));
+}
+
+uint32_t
+WPN114::Network::Tree::
+find_id(std::string_view address) const
+{
+    if (address.empty())
+        return m_root.id();
+
+    auto entry = m_index.find(address);
+    return entry == m_index.end() ? 0 : entry->second;
+}
 
-    Node* target = &m_root;
+Node*
+WPN114::Network::Tree::
+node(uint32_t id)
+{
+    if (id >= uint32_t(m_nodes.size()))
+        return nullptr;
 
-    for (auto& name : split) {
-        auto subnode = target->subnode(name);
-        if (subnode == nullptr)
-             return nullptr;
-        else target = subnode;
+    if (m_nodes[id] == nullptr && m_records[id] && !m_records[id]->address.isEmpty()) {
+        // loading the parent's subnodes loads this one along with its siblings
+        if (auto parent = node(m_records[id]->parent))
+            parent->subnodes();
     }
 
-    return target;
+    return m_nodes[id];
+}
+
+QVariant
+WPN114::Network::Tree::
+value(uint32_t id) const
+{
+    if (id >= uint32_t(m_nodes.size()))
+        return QVariant();
+
+    if  (auto node = m_nodes[id])
+         return node->value();
+    else if (auto record = m_records[id])
+         return record->value.to_variant();
+    else return QVariant();
+}
+
+void
+WPN114::Network::Tree::
+set_value(uint32_t id, QVariant const& value)
+{
+    if (id >= uint32_t(m_nodes.size()))
+        return;
+
+    if  (auto node = m_nodes[id])
+         node->set_value(value);
+    else if (auto record = m_records[id]) {
+         record->value = Value::from_variant(value, record->type);
+         invalidate_record(id, true);
+    }
+}
+
+void
+WPN114::Network::Tree::
+set_value(uint32_t id, OSCView const& message)
+{
+    if (id >= uint32_t(m_nodes.size()))
+        return;
+
+    if  (auto node = m_nodes[id])
+         node->set_value(Value::from_osc(message, node->type()));
+    else if (auto record = m_records[id]) {
+         record->value = Value::from_osc(message, record->type);
+         invalidate_record(id, true);
+    }
 }
 
 Node*
@@ -155,19 +223,475 @@ find_or_create(QString path)
     if (path == "/" || path.isEmpty())
         return &m_root;
 
-    auto split = path.split('/');
-    split.removeFirst();
+    if (auto node = find(path))
+        return node;
+
+    auto parent = find_or_create(parent_path(path));
+    return parent->create_subnode(path.split('/').last());
+}
+
+void
+WPN114::Network::Tree::
+index(Node* node, bool recursive)
+{
+    auto& address = node->address();
+    auto key = std::string_view(address.constData(), address.size());
+    node->set_tree(this);
+
+    // replace the whole entry: an existing key would still point into the previous node's path
+    if (node->id() == 0 || node->id() >= uint32_t(m_nodes.size())) {
+        node->set_id(m_nodes.size(), atom(node->name()));
+        m_nodes << node;
+        m_records << nullptr;
+    }
+    else m_nodes[node->id()] = node;
+
+    m_index.erase(key);
+    m_index.emplace(key, node->id());
+    ++m_structure;
+    update_storage(node);
+
+    // subnodes that are still records are indexed already
+    if (recursive)
+        for (const auto& subnode : node->loaded_subnodes())
+             index(subnode);
+}
+
+bool
+WPN114::Network::Tree::
+unindex(Node* node, bool recursive)
+{
+    auto& address = node->address();
+    auto entry = m_index.find(std::string_view(address.constData(), address.size()));
+    bool indexed = entry != m_index.end() && entry->second == node->id() &&
+                   node->id() < uint32_t(m_nodes.size()) && m_nodes[node->id()] == node;
+
+    if (indexed) {
+        m_index.erase(entry);
+        ++m_structure;
+        m_nodes[node->id()] = nullptr;
+        node->set_stored(false);
+    }
+
+    if (recursive) {
+        for (const auto& subnode : node->loaded_subnodes())
+             unindex(subnode);
+        release_records(node->id());
+    }
+
+    return indexed;
+}
+
+uint32_t
+WPN114::Network::Tree::
+atom(QString const& name)
+{
+    auto atom = m_atoms.value(name, 0);
+
+    if (atom == 0) {
+        atom = m_atom_names.size();
+        m_atoms.insert(name, atom);
+        m_atom_names << name;
+    }
+
+    return atom;
+}
+
+//-------------------------------------------------------------------------------------------------
+// PUBLISHING
+//-------------------------------------------------------------------------------------------------
+
+void
+WPN114::Network::Tree::
+set_publishing(bool enabled)
+{
+    m_publishing = enabled;
+
+    if  (enabled)
+         publish();
+    else std::atomic_store(&m_published, std::shared_ptr<const NamespaceSnapshot>());
+}
+
+void
+WPN114::Network::Tree::
+schedule_publish(bool values_only)
+{
+    if (!m_publishing || m_publish_pending)
+        return;
+
+    if (values_only) {
+        // streaming values would otherwise rebuild the whole snapshot on every turn
+        if (!m_value_publish_timer.isActive())
+            m_value_publish_timer.start();
+        return;
+    }
+
+    // changes made within the same event loop turn are published together
+    m_publish_pending = true;
+    QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection);
+}
+
+void
+WPN114::Network::Tree::
+publish()
+{
+    m_publish_pending = false;
+    m_value_publish_timer.stop();
+
+    if (!m_publishing)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // the path index only needs to be copied when the structure has changed
+    auto current = std::atomic_load(&m_published);
+    std::shared_ptr<const NamespaceSnapshot::Index> index;
+
+    if (current && current->structure() == m_structure)
+        index = current->index();
+    else index = std::make_shared<NamespaceSnapshot::Index>(m_index);
+
+    std::shared_ptr<const NamespaceSnapshot> snapshot =
+            std::make_shared<NamespaceSnapshot>(m_root, std::move(index), m_structure);
+
+    std::atomic_store(&m_published, std::move(snapshot));
+
+    m_publish_count++;
+    m_publish_nsecs += timer.nsecsElapsed();
+}
+
+QVariantMap
+WPN114::Network::Tree::
+publishStatistics() const
+{
+    qulonglong
+    count = m_publish_count,
+    nsecs = m_publish_nsecs;
+
+    return QVariantMap {
+        { "published", count },
+        { "totalUsecs", nsecs/1000 },
+        { "averageUsecs", count ? double(nsecs)/count/1000 : 0. }
+    };
+}
+
+//-------------------------------------------------------------------------------------------------
+// VALUE STORE
+//-------------------------------------------------------------------------------------------------
+
+void
+WPN114::Network::Tree::
+set_value_store(bool enabled)
+{
+    m_value_store = enabled;
+
+    for (const auto& node : m_nodes)
+         if (node) update_storage(node);
+}
+
+void
+WPN114::Network::Tree::
+update_storage(Node* node)
+{
+    auto id = node->id();
+    auto store = m_value_store && ValueStore::stores(node->type()) &&
+                 id < uint32_t(m_nodes.size()) && m_nodes[id] == node;
+
+    // a type change needs a slot of the new kind
+    if (node->stored() && (!store || m_values.type(id) != node->type()))
+        node->set_stored(false);
+
+    node->set_stored(store);
+}
+
+void
+WPN114::Network::Tree::
+recall(ValueStore::Snapshot const& snapshot)
+{
+    for (auto id : m_values.recall(snapshot)) {
+        auto node = m_nodes[id];
+        emit node->valueChanged(node->value());
+        node->invalidate_json(true);
+
+        if (node->observed())
+            notify(*node);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// MIRRORING
+//-------------------------------------------------------------------------------------------------
+
+void
+WPN114::Network::Tree::
+mirror(QJsonObject const& object)
+{
+    auto path = object["FULL_PATH"].toString();
+    auto id = mirror_path(path);
+
+    if (auto node = m_nodes[id]) {
+        auto attributes = object;
+        attributes.remove("CONTENTS");
+        node->update(attributes);
+    }
+    else
+    {
+        auto& record = *m_records[id];
+
+        if (object.contains("TYPE"))
+            record.type = Node::type_from_tag(object["TYPE"].toString());
 
-    Node* target = &m_root;
+        if (object.contains("VALUE"))
+            record.value = Value::from_variant(Node::value_from_json(record.type, object["VALUE"]), record.type);
 
-    for (auto& name : split) {
-        auto subnode = target->subnode(name);
-        if (subnode == nullptr)
-            subnode = target->create_subnode(name);
-        target = subnode;
+        invalidate_record(id);
     }
 
-    return target;
+    auto contents = object["CONTENTS"].toObject();
+
+    for (auto it = contents.constBegin(); it != contents.constEnd(); ++it)
+    {
+        auto subobject = it.value().toObject();
+
+        if (!subobject.contains("FULL_PATH"))
+            subobject["FULL_PATH"] = path == "/" ?
+                        path + it.key() : path + '/' + it.key();
+
+        mirror(subobject);
+    }
+}
+
+uint32_t
+WPN114::Network::Tree::
+mirror_path(QString const& path)
+{
+    auto address = path.toUtf8();
+
+    if (auto id = find_id(std::string_view(address.constData(), address.size())))
+        return id;
+
+    auto parent_id = mirror_path(parent_path(path));
+    auto parent = m_nodes[parent_id];
+    auto name = path.section('/', -1);
+
+    if (parent && parent->expanded()) {
+        // siblings are all loaded, so this one has to be as well,
+        // only its own subnodes can be kept as records
+        auto node = make_node(*parent, name, Type::None);
+        node->set_expanded(false);
+        parent->add_subnode(node);
+        return node->id();
+    }
+
+    auto record = new (m_record_pool.allocate()) Record;
+    record->address = address;
+    record->parent = parent_id;
+    record->atom = atom(name);
+
+    uint32_t id = m_nodes.size();
+    m_nodes << nullptr;
+    m_records << record;
+
+    m_index.emplace(std::string_view(record->address.constData(), record->address.size()), id);
+    ++m_structure;
+    Tree::record(parent_id).subnodes << id;
+    invalidate_record(id);
+
+    return id;
+}
+
+Tree::Record&
+WPN114::Network::Tree::
+record(uint32_t id)
+{
+    if (!m_records[id])
+        m_records[id] = new (m_record_pool.allocate()) Record;
+
+    return *m_records[id];
+}
+
+void
+WPN114::Network::Tree::
+load_subnodes(Node* node)
+{
+    node->set_expanded(true);
+
+    auto record = m_records.value(node->id());
+    if (!record)
+        return;
+
+    for (auto id : record->subnodes)
+         load(id, *node);
+
+    m_records[node->id()] = nullptr;
+    record->~Record();
+    m_record_pool.release(record);
+
+    // same json, but it now has to be rebuilt from the new subnodes' own
+    node->invalidate_json(true);
+}
+
+void
+WPN114::Network::Tree::
+append_records_json(uint32_t id, QByteArray& out)
+{
+    auto record = m_records.value(id);
+    if (!record)
+        return;
+
+    bool first = true;
+
+    for (auto subnode : record->subnodes)
+    {
+        if (!m_records[subnode])
+            continue;
+
+        if (!first)
+            out.append(',');
+
+        append_json_string(out, atom_name(m_records[subnode]->atom));
+        out.append(':');
+        append_record_json(subnode, out);
+        first = false;
+    }
+}
+
+void
+WPN114::Network::Tree::
+append_record_json(uint32_t id, QByteArray& out)
+// same attributes as the node it would be loaded into
+{
+    auto& record = *m_records[id];
+    QJsonObject attributes { { "FULL_PATH", QString::fromUtf8(record.address) } };
+
+    if (record.type != Type::None) {
+        attributes["TYPE"] = Node::typetag(record.type);
+        attributes["CRITICAL"] = false;
+        attributes["VALUE"] = Node::value_json(record.type, record.value);
+    }
+
+    auto json = QJsonDocument(attributes).toJson(QJsonDocument::Compact);
+
+    record.json_begin = out.size();
+    out.append(json.constData(), json.size()-1);
+    record.json_attributes = out.size();
+    out.append(",\"CONTENTS\":{");
+
+    append_records_json(id, out);
+
+    out.append("}}");
+    record.json_end = out.size();
+}
+
+void
+WPN114::Network::Tree::
+locate_records(uint32_t id, int offset, std::vector<NamespaceSnapshot::Range>& ranges) const
+{
+    auto record = m_records.value(id);
+    if (!record)
+        return;
+
+    for (auto subnode : record->subnodes)
+    {
+        auto subrecord = m_records[subnode];
+        if (!subrecord)
+            continue;
+
+        if (subnode >= ranges.size())
+            ranges.resize(subnode+1);
+
+        ranges[subnode] = { offset+subrecord->json_begin, offset+subrecord->json_attributes,
+                            offset+subrecord->json_end };
+
+        locate_records(subnode, offset, ranges);
+    }
+}
+
+void
+WPN114::Network::Tree::
+invalidate_record(uint32_t id, bool value_only)
+{
+    auto parent = m_records[id]->parent;
+
+    while (!m_nodes[parent] && m_records[parent])
+           parent = m_records[parent]->parent;
+
+    if (auto node = m_nodes[parent])
+        node->invalidate_json(value_only);
+}
+
+void
+WPN114::Network::Tree::
+load(uint32_t id, Node& parent)
+{
+    auto record = m_records[id];
+    auto node = make_node(parent, atom_name(record->atom), record->type);
+
+    node->set_id(id, record->atom);
+    node->set_value(record->value);
+    index(node, false);
+
+    // not a new node as far as the tree is concerned: no notify_added
+    parent.subnodes().push_back(node);
+
+    if (record->subnodes.isEmpty()) {
+        m_records[id] = nullptr;
+        record->~Record();
+        m_record_pool.release(record);
+    }
+    else {
+        node->set_expanded(false);
+        record->address.clear();
+        record->value = Value();
+    }
+}
+
+void
+WPN114::Network::Tree::
+release_records(uint32_t id)
+{
+    auto record = m_records.value(id);
+    if (!record)
+        return;
+
+    for (auto subnode : record->subnodes)
+         release_records(subnode);
+
+    if (!record->address.isEmpty()) {
+        // only indexed records are part of what gets published
+        m_index.erase(std::string_view(record->address.constData(), record->address.size()));
+        ++m_structure;
+    }
+
+    m_records[id] = nullptr;
+    record->~Record();
+    m_record_pool.release(record);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+QVector<Node*> const&
+WPN114::Network::Tree::
+match(QString const& pattern)
+{
+    auto match = m_matches.find(pattern);
+
+    if (match == m_matches.end()) {
+        if (m_matches.size() >= max_matches)
+            m_matches.clear();
+        match = m_matches.insert(pattern, Match { OSCPattern(pattern) });
+    }
+
+    // the compiled pattern is kept, only its node set goes stale.
+    // resolving may load records, which doesn't change what matches
+    if (match->structure != m_structure) {
+        match->nodes.clear();
+        match->pattern.resolve(&m_root, match->nodes);
+        match->structure = m_structure;
+    }
+
+    return match->nodes;
 }
 
 QString
@@ -191,3 +715,13 @@ query(QString const& uri)
          return QJsonObject();
     else return static_cast<QJsonObject>(*node);
 }
+
+QByteArray
+WPN114::Network::Tree::
+query_json(QString const& uri)
+{
+    auto node = find(uri);
+    if  (!node)
+         return QByteArrayLiteral("{}");
+    else return node->json();
+}
@@ -13,14 +13,44 @@
 #include <QFile>
 #include <QAbstractItemModel>
 #include <QHash>
+#include <QTimer>
+#include <unordered_map>
+#include <string_view>
+#include <memory>
 
 #include "node.hpp"
+#include "pattern.hpp"
+#include "pool.hpp"
+#include "store.hpp"
+#include "snapshot.hpp"
 
 namespace WPN114  {
 namespace Network {
 
 class Tree;
 
+//=================================================================================================
+class TreeObserver
+//=================================================================================================
+// notified of value changes on observed nodes, without going through Qt signals
+{
+public:
+
+    virtual void
+    on_value_changed(Node& node) = 0;
+
+    virtual void
+    on_subtree_added(Node& node) {}
+    // 'node' has been added to the tree along with its subnodes, which aren't notified on their own
+
+    virtual void
+    on_subtree_removed(Node& node) {}
+
+protected:
+
+    ~TreeObserver() = default;
+};
+
 //=================================================================================================
 class TreeModel : public QAbstractItemModel
 //=================================================================================================
@@ -125,24 +155,161 @@ class Tree : public QObject
     //---------------------------------------------------------------------------------------------
     Q_PROPERTY (Node* root READ root)
 
+    //---------------------------------------------------------------------------------------------
+    Q_PROPERTY (bool valueStore READ value_store WRITE set_value_store)
+    // keeps Int, Float, Bool and Vec values in contiguous per-type arrays
+
     //---------------------------------------------------------------------------------------------
     QString
     m_name = "wpn114tree";
 
+    //---------------------------------------------------------------------------------------------
+    struct Record
+    // compact, QObject-free stand-in for a mirrored node that nobody has asked for yet.
+    // a loaded node keeps its record (address and value cleared) until its own subnodes are loaded
+    {
+        QByteArray
+        address;
+
+        Value
+        value;
+
+        QVector<uint32_t>
+        subnodes;
+
+        uint32_t
+        parent = 0,
+        atom = 0;
+
+        Type::Values
+        type = Type::None;
+
+        int
+        json_begin = 0,
+        json_attributes = 0,
+        json_end = 0;
+        // where it was last serialized, within its nearest loaded ancestor's cached json
+    };
+
+    SlabPool<Node>
+    m_pool;
+    // storage for nodes created by the tree itself (e.g. client mirrors),
+    // declared first so that it outlives every node it holds
+
+    SlabPool<Record, 1024>
+    m_record_pool;
+
+    std::unordered_map<std::string_view, uint32_t>
+    m_index;
+    // full utf8 path -> id, keys point into each node's (or record's) own address
+    // declared before m_root, which unindexes its subnodes when destroyed
+
+    QVector<Node*>
+    m_nodes;
+    // id -> node, ids are never reused so stale ids resolve to nullptr
+
+    QVector<Record*>
+    m_records;
+    // id -> record, for mirrored nodes or subnodes that haven't been loaded yet
+
+    QHash<QString, uint32_t>
+    m_atoms;
+
+    QVector<QString>
+    m_atom_names;
+
+    ValueStore
+    m_values;
+
+    bool
+    m_value_store = false;
+
+    std::shared_ptr<const NamespaceSnapshot>
+    m_published;
+    // only ever accessed through std::atomic_load/atomic_store
+
+    uint64_t
+    m_structure = 0;
+    // bumped whenever a path is added to or removed from the index
+
+    bool
+    m_publishing = false,
+    m_publish_pending = false;
+
+    QTimer
+    m_value_publish_timer;
+
+    uint64_t
+    m_publish_count = 0,
+    m_publish_nsecs = 0;
+
+    TreeObserver*
+    m_observer = nullptr;
+
     Node
     m_root;
 
     static Tree*
     s_singleton;
 
+    //---------------------------------------------------------------------------------------------
+    struct Match
+    {
+        OSCPattern
+        pattern;
+
+        QVector<Node*>
+        nodes;
+
+        uint64_t
+        structure = 0;
+        // tree structure the nodes were resolved against, 0 if they haven't been yet
+    };
+
+    QHash<QString, Match>
+    m_matches;
+    // compiled patterns, along with the nodes they resolved to
+
+    static constexpr int
+    max_matches = 256;
+
+    //---------------------------------------------------------------------------------------------
+    uint32_t
+    mirror_path(QString const& path);
+    // id of the node or record at 'path', creating it (and its parents) if needed
+
+    Record&
+    record(uint32_t id);
+    // creates an empty one if needed
+
+    void
+    load(uint32_t id, Node& parent);
+
+    void
+    append_record_json(uint32_t id, QByteArray& out);
+
+    void
+    invalidate_record(uint32_t id, bool value_only = false);
+    // marks the cached json holding the record as stale
+
 public:
 
     //---------------------------------------------------------------------------------------------
     Tree()
     //---------------------------------------------------------------------------------------------
     {
+        // id/atom 0 mean 'none'
+        m_nodes << nullptr;
+        m_records << nullptr;
+        m_atom_names << QString();
+
         m_root.set_path("/");
         m_root.set_tree(this);
+        index(&m_root, false);
+
+        m_value_publish_timer.setSingleShot(true);
+        m_value_publish_timer.setInterval(value_publish_interval);
+        QObject::connect(&m_value_publish_timer, &QTimer::timeout, this, &Tree::publish);
     }
 
     //---------------------------------------------------------------------------------------------
@@ -182,11 +349,171 @@ public:
     Node*
     find(QString path);
 
+    Node*
+    find(std::string_view address) { return node(find_id(address)); }
+
+    uint32_t
+    find_id(std::string_view address) const;
+    // constant-time, allocation-free lookup from a utf8 address, 0 if not found
+
+    //---------------------------------------------------------------------------------------------
+    Node*
+    node(uint32_t id);
+    // loads the node first if it is only held as a record
+
+    uint32_t
+    id(QString const& path)
+    {
+        auto address = path.toUtf8();
+        return find_id(std::string_view(address.constData(), address.size()));
+    }
+
+    //---------------------------------------------------------------------------------------------
+    QVariant
+    value(uint32_t id) const;
+
+    void
+    set_value(uint32_t id, QVariant const& value);
+    // neither of these load the node
+
+    void
+    set_value(uint32_t id, OSCView const& message);
+    // reads the message arguments straight into the node's (or record's) typed value
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    value_store() const { return m_value_store; }
+
+    void
+    set_value_store(bool enabled);
+
+    ValueStore&
+    values() { return m_values; }
+
+    void
+    update_storage(Node* node);
+    // moves node's value in or out of the value store, depending on its type
+
+    //---------------------------------------------------------------------------------------------
+    void
+    set_observer(TreeObserver* observer) { m_observer = observer; }
+
+    void
+    notify(Node& node) { if (m_observer) m_observer->on_value_changed(node); }
+    // called by observed nodes, once their value has changed
+
+    void
+    notify_added(Node& node) { if (m_observer) m_observer->on_subtree_added(node); }
+
+    void
+    notify_removed(Node& node) { if (m_observer) m_observer->on_subtree_removed(node); }
+    // called by parent nodes, once 'node' has been (un)indexed
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    publishing() const { return m_publishing; }
+
+    void
+    set_publishing(bool enabled);
+    // when enabled, an immutable copy of the namespace is published for other threads
+    // to read without locking: after each event loop turn in which its structure or attributes
+    // have changed, and at most every value_publish_interval when only values have
+
+    static constexpr int
+    value_publish_interval = 250;
+    // ms, rebuilding the snapshot is linear in the size of the namespace
+
+    std::shared_ptr<const NamespaceSnapshot>
+    published() const { return std::atomic_load(&m_published); }
+    // thread-safe, null unless publishing
+
+    void
+    schedule_publish(bool values_only = false);
+
+    Q_INVOKABLE void
+    publish();
+
+    Q_INVOKABLE QVariantMap
+    publishStatistics() const;
+    // snapshots published so far, and the time it took to build them
+
+    //---------------------------------------------------------------------------------------------
+    ValueStore::Snapshot
+    snapshot() const { return m_values.snapshot(); }
+    // values of all the stored nodes, e.g. for presets
+
+    void
+    recall(ValueStore::Snapshot const& snapshot);
+    // restores a snapshot, notifying the nodes that changed
+
+    //---------------------------------------------------------------------------------------------
+    void
+    mirror(QJsonObject const& object);
+    // merges a remote namespace (or part of it) into the tree,
+    // new branches are kept as records until QML or C++ asks for their nodes
+
+    void
+    load_subnodes(Node* node);
+    // creates nodes for the records below 'node'
+
+    void
+    append_records_json(uint32_t id, QByteArray& out);
+    // CONTENTS entries for the records below node 'id', without loading them
+
+    void
+    locate_records(uint32_t id, int offset, std::vector<NamespaceSnapshot::Range>& ranges) const;
+    // slices of the records below node 'id', whose cached json starts at 'offset'
+
+    //---------------------------------------------------------------------------------------------
+    uint32_t
+    atom(QString const& name);
+    // interns name, creating a new atom if needed
+
+    uint32_t
+    find_atom(QString const& name) const { return m_atoms.value(name, 0); }
+    // 0 if 'name' has never been interned
+
+    QString
+    atom_name(uint32_t atom) const { return m_atom_names.value(atom); }
+
+    //---------------------------------------------------------------------------------------------
+    void
+    index(Node* node, bool recursive = true);
+    // registers node (and its subnodes) in the path index
+
+    bool
+    unindex(Node* node, bool recursive = true);
+    // returns false if node wasn't indexed
 
     //---------------------------------------------------------------------------------------------
     Node*
     find_or_create(QString path);
 
+    //---------------------------------------------------------------------------------------------
+    template<typename... _Args> Node*
+    make_node(_Args&&... args)
+    // allocates a plain Node from the tree's pool, deleting it hands it back
+    {
+        auto node = new (m_pool.allocate()) Node(std::forward<_Args>(args)...);
+        node->set_allocator(this);
+        QQmlEngine::setObjectOwnership(node, QQmlEngine::CppOwnership);
+        return node;
+    }
+
+    void
+    release_node(void* node) { m_pool.release(node); }
+    // storage of a pooled node that has been destroyed, see Node::operator delete
+
+    void
+    release_records(uint32_t id);
+    // drops the records below a node whose subnodes haven't been loaded
+
+    //---------------------------------------------------------------------------------------------
+    QVector<Node*> const&
+    match(QString const& pattern);
+    // nodes matching an OSC address pattern, cached until the tree structure changes
+    // (nodes or mirrored records being added, loaded or removed)
+
     //---------------------------------------------------------------------------------------------
     QString
     parent_path(QString path);
@@ -195,6 +522,10 @@ public:
     QJsonObject const
     query(QString const& uri);
 
+    QByteArray
+    query_json(QString const& uri);
+    // serialized query, served from the nodes' cached json
+
     //---------------------------------------------------------------------------------------------
     Q_INVOKABLE TreeModel*
     model()
@@ -205,13 +536,7 @@ public:
 
     //---------------------------------------------------------------------------------------------
     QVariant
-    value(QString const& uri)
-    //---------------------------------------------------------------------------------------------
-    {
-        if  (auto node = find(uri))
-             return node->value();
-        else return QVariant();
-    }
+    value(QString const& uri) { return value(id(uri)); }
 };
 
 }
@@ -0,0 +1,217 @@
+#include "udp.hpp"
+
+#ifdef WPN114_UDP_BATCHING
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+using namespace WPN114::Network;
+
+WPN114::Network::UdpSocket::
+UdpSocket()
+{
+    m_buffers.resize(batch_size*max_datagram_size);
+}
+
+bool
+WPN114::Network::UdpSocket::
+bind(uint16_t port)
+{
+    close();
+
+    m_socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket < 0)
+        return false;
+
+    int reuse = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0) | O_NONBLOCK);
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (::bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void
+WPN114::Network::UdpSocket::
+close()
+{
+    if (m_socket >= 0)
+        ::close(m_socket);
+
+    m_socket = -1;
+}
+
+bool
+WPN114::Network::UdpSocket::
+wait(int timeout)
+{
+    pollfd pfd = { m_socket, POLLIN, 0 };
+    return ::poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN);
+}
+
+bool
+WPN114::Network::UdpSocket::
+resolve(QByteArray const& address, sockaddr_in& result)
+{
+    auto host = address;
+    if (host.startsWith("udp://"))
+        host.remove(0, 6);
+
+    auto colon = host.lastIndexOf(':');
+    if (colon < 0)
+        return false;
+
+    bool ok = false;
+    auto port = host.mid(colon+1).toUShort(&ok);
+    host.truncate(colon);
+
+    result = {};
+    result.sin_family = AF_INET;
+    result.sin_port = htons(port);
+
+    return ok && inet_pton(AF_INET, host.constData(), &result.sin_addr) == 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+#ifdef __linux__
+//-------------------------------------------------------------------------------------------------
+
+int
+WPN114::Network::UdpSocket::
+receive(Datagram* datagrams)
+{
+    mmsghdr headers[batch_size] = {};
+    iovec vectors[batch_size];
+
+    for (int n = 0; n < batch_size; ++n) {
+        vectors[n].iov_base = m_buffers.data()+n*max_datagram_size;
+        vectors[n].iov_len = max_datagram_size;
+        headers[n].msg_hdr.msg_iov = &vectors[n];
+        headers[n].msg_hdr.msg_iovlen = 1;
+        headers[n].msg_hdr.msg_name = &datagrams[n].address;
+        headers[n].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    auto count = recvmmsg(m_socket, headers, batch_size, MSG_DONTWAIT, nullptr);
+    if (count <= 0)
+        return 0;
+
+    for (int n = 0; n < count; ++n) {
+        datagrams[n].data = static_cast<const char*>(vectors[n].iov_base);
+        datagrams[n].size = headers[n].msg_len;
+    }
+
+    m_counters.receive_calls.fetch_add(1, std::memory_order_relaxed);
+    m_counters.received.fetch_add(count, std::memory_order_relaxed);
+
+    return count;
+}
+
+int
+WPN114::Network::UdpSocket::
+send(Datagram const* datagrams, int count)
+{
+    int sent = 0;
+
+    while (sent < count)
+    {
+        auto batch = qMin(count-sent, batch_size);
+        mmsghdr headers[batch_size] = {};
+        iovec vectors[batch_size];
+
+        for (int n = 0; n < batch; ++n) {
+            auto& datagram = datagrams[sent+n];
+            vectors[n].iov_base = const_cast<char*>(datagram.data);
+            vectors[n].iov_len = datagram.size;
+            headers[n].msg_hdr.msg_iov = &vectors[n];
+            headers[n].msg_hdr.msg_iovlen = 1;
+            headers[n].msg_hdr.msg_name = const_cast<sockaddr_in*>(&datagram.address);
+            headers[n].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+
+        auto result = sendmmsg(m_socket, headers, batch, 0);
+        m_counters.send_calls.fetch_add(1, std::memory_order_relaxed);
+
+        if (result <= 0) {
+            // skip the datagram that failed rather than retrying it forever
+            m_counters.dropped.fetch_add(1, std::memory_order_relaxed);
+            ++sent;
+            continue;
+        }
+
+        m_counters.sent.fetch_add(result, std::memory_order_relaxed);
+        sent += result;
+    }
+
+    return sent;
+}
+
+//-------------------------------------------------------------------------------------------------
+#else
+//-------------------------------------------------------------------------------------------------
+
+int
+WPN114::Network::UdpSocket::
+receive(Datagram* datagrams)
+{
+    int count = 0;
+
+    for (; count < batch_size; ++count)
+    {
+        auto& datagram = datagrams[count];
+        auto buffer = m_buffers.data()+count*max_datagram_size;
+        socklen_t length = sizeof(sockaddr_in);
+
+        auto size = recvfrom(m_socket, buffer, max_datagram_size, 0,
+                             reinterpret_cast<sockaddr*>(&datagram.address), &length);
+        if (size < 0)
+            break;
+
+        datagram.data = buffer;
+        datagram.size = size;
+        m_counters.receive_calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_counters.received.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+int
+WPN114::Network::UdpSocket::
+send(Datagram const* datagrams, int count)
+{
+    int sent = 0;
+
+    for (int n = 0; n < count; ++n)
+    {
+        auto& datagram = datagrams[n];
+        auto result = sendto(m_socket, datagram.data, datagram.size, 0,
+                             reinterpret_cast<const sockaddr*>(&datagram.address), sizeof(sockaddr_in));
+
+        m_counters.send_calls.fetch_add(1, std::memory_order_relaxed);
+
+        if  (result < 0)
+             m_counters.dropped.fetch_add(1, std::memory_order_relaxed);
+        else ++sent;
+    }
+
+    m_counters.sent.fetch_add(sent, std::memory_order_relaxed);
+    return sent;
+}
+
+#endif
+
+#endif
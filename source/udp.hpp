@@ -0,0 +1,115 @@
+#pragma once
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WPN114_UDP_BATCHING
+#endif
+// elsewhere, udp goes through mongoose: a listener on the server, a sender per peer
+
+#ifdef WPN114_UDP_BATCHING
+
+#include <QByteArray>
+#include <QVector>
+#include <atomic>
+#include <cstdint>
+#include <netinet/in.h>
+
+namespace WPN114  {
+namespace Network {
+
+//=================================================================================================
+class UdpSocket
+//=================================================================================================
+// datagram socket moving several datagrams per system call:
+// recvmmsg/sendmmsg on linux, a non-blocking recvfrom/sendto loop on other posix systems.
+// receiving and sending may happen on two different threads
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    static constexpr int
+    batch_size = 64,
+    max_datagram_size = 8192;
+
+    //---------------------------------------------------------------------------------------------
+    struct Datagram
+    {
+        const char*
+        data = nullptr;
+
+        size_t
+        size = 0;
+
+        sockaddr_in
+        address;
+    };
+
+    //---------------------------------------------------------------------------------------------
+    struct Counters
+    {
+        std::atomic<uint64_t>
+        receive_calls { 0 },
+        received { 0 },
+        send_calls { 0 },
+        sent { 0 },
+        dropped { 0 };
+        // datagrams the kernel refused to send, e.g. with a full send buffer
+    };
+
+    //---------------------------------------------------------------------------------------------
+    UdpSocket();
+
+    UdpSocket(UdpSocket const&) = delete;
+
+    ~UdpSocket() { close(); }
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    bind(uint16_t port);
+    // any interface
+
+    void
+    close();
+
+    bool
+    is_open() const { return m_socket >= 0; }
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    wait(int timeout);
+    // blocks until there is something to read or 'timeout' (ms) has passed
+
+    int
+    receive(Datagram* datagrams);
+    // reads up to batch_size pending datagrams without blocking, returns how many were read.
+    // their data points into the socket's own buffers and stays valid until the next call
+
+    int
+    send(Datagram const* datagrams, int count);
+    // returns how many were handed to the kernel
+
+    //---------------------------------------------------------------------------------------------
+    static bool
+    resolve(QByteArray const& address, sockaddr_in& result);
+    // from 'udp://ip:port' (or 'ip:port'), numeric ipv4 only
+
+    Counters const&
+    counters() const { return m_counters; }
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    int
+    m_socket = -1;
+
+    QByteArray
+    m_buffers;
+    // batch_size receive buffers, max_datagram_size each
+
+    Counters
+    m_counters;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,351 @@
+#include "value.hpp"
+#include "osc.hpp"
+#include <QVector2D>
+#include <QVector3D>
+#include <QVector4D>
+#include <algorithm>
+
+using namespace WPN114::Network;
+
+bool
+WPN114::Network::Value::
+typed(Type::Values type)
+{
+    switch (type)
+    {
+    case Type::Bool:
+    case Type::Int:
+    case Type::Int64:
+    case Type::Float:
+    case Type::Double:
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:
+    case Type::String:
+    case Type::Blob:
+    case Type::Midi:
+    case Type::Char:
+    case Type::Timetag:     return true;
+    default:                return false;
+    }
+}
+
+int
+WPN114::Network::Value::
+width() const
+{
+    switch (m_type)
+    {
+    case Type::Vec2f:   return 2;
+    case Type::Vec3f:   return 3;
+    case Type::Vec4f:   return 4;
+    default:            return 1;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+Value
+WPN114::Network::Value::
+vec(const float* values, int width)
+{
+    Value value;
+    value.m_type = width == 2 ? Type::Vec2f : width == 3 ? Type::Vec3f : Type::Vec4f;
+    std::copy(values, values+qBound(0, width, 4), value.m_data.f);
+    return value;
+}
+
+Value
+WPN114::Network::Value::
+bytes(Type::Values type, QByteArray const& bytes)
+{
+    Value value;
+    value.m_type = type;
+    value.m_bytes = bytes;
+    return value;
+}
+
+Value
+WPN114::Network::Value::
+integer(Type::Values type, int64_t integer)
+{
+    Value value;
+    value.m_type = type;
+    value.m_data.h = integer;
+    return value;
+}
+
+Value
+WPN114::Network::Value::
+variant(Type::Values type, QVariant const& variant)
+{
+    Value value;
+    value.m_type = type;
+    value.m_variant = variant;
+    return value;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool
+WPN114::Network::Value::
+to_bool() const
+{
+    switch (m_type)
+    {
+    case Type::Bool:        return m_data.b;
+    case Type::Float:
+    case Type::Double:
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:       return to_double() != 0;
+    case Type::String:
+    case Type::Blob:        return !m_bytes.isEmpty();
+    default:                return typed() ? to_int64() != 0 : m_variant.toBool();
+    }
+}
+
+int64_t
+WPN114::Network::Value::
+to_int64() const
+{
+    switch (m_type)
+    {
+    case Type::Bool:        return m_data.b;
+    case Type::Int:         return m_data.i;
+    case Type::Int64:
+    case Type::Midi:
+    case Type::Char:
+    case Type::Timetag:     return m_data.h;
+    case Type::Float:
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:       return static_cast<int64_t>(m_data.f[0]);
+    case Type::Double:      return static_cast<int64_t>(m_data.d);
+    case Type::String:      return m_bytes.toLongLong();
+    case Type::Blob:        return 0;
+    default:                return m_variant.toLongLong();
+    }
+}
+
+double
+WPN114::Network::Value::
+to_double() const
+{
+    switch (m_type)
+    {
+    case Type::Float:
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:       return m_data.f[0];
+    case Type::Double:      return m_data.d;
+    case Type::String:      return m_bytes.toDouble();
+    case Type::Blob:        return 0;
+    default:                return typed() ? static_cast<double>(to_int64()) : m_variant.toDouble();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool
+WPN114::Network::Value::
+operator==(Value const& rhs) const
+{
+    if (m_type != rhs.m_type)
+        return false;
+
+    switch (m_type)
+    {
+    case Type::Bool:        return m_data.b == rhs.m_data.b;
+    case Type::Int:         return m_data.i == rhs.m_data.i;
+    case Type::Int64:
+    case Type::Midi:
+    case Type::Char:
+    case Type::Timetag:     return m_data.h == rhs.m_data.h;
+    case Type::Float:       return m_data.f[0] == rhs.m_data.f[0];
+    case Type::Double:      return m_data.d == rhs.m_data.d;
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:       return std::equal(m_data.f, m_data.f+4, rhs.m_data.f);
+    case Type::String:
+    case Type::Blob:        return m_bytes == rhs.m_bytes;
+    default:                return m_variant == rhs.m_variant;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+Value
+WPN114::Network::Value::
+from_variant(QVariant const& value, Type::Values type)
+{
+    switch (type)
+    {
+    case Type::Bool:        return value.toBool();
+    case Type::Int:         return static_cast<int32_t>(value.toInt());
+    case Type::Int64:       return static_cast<int64_t>(value.toLongLong());
+    case Type::Float:       return value.toFloat();
+    case Type::Double:      return value.toDouble();
+    case Type::String:      return bytes(type, value.toString().toUtf8());
+    case Type::Blob:        return bytes(type, value.toByteArray());
+    case Type::Midi:        return integer(type, value.toUInt());
+    case Type::Timetag:     return integer(type, static_cast<int64_t>(value.toULongLong()));
+    case Type::Char:
+    {
+        auto string = value.toString();
+        return integer(type, string.isEmpty() ? value.toInt() : string[0].unicode());
+    }
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:
+    {
+        float lanes[4] = { 0, 0, 0, 0 };
+        auto width = type == Type::Vec2f ? 2 : type == Type::Vec3f ? 3 : 4;
+
+        switch (value.userType())
+        {
+        case QMetaType::QVector2D:
+        {
+            auto vec = value.value<QVector2D>();
+            lanes[0] = vec.x(); lanes[1] = vec.y();
+            break;
+        }
+        case QMetaType::QVector3D:
+        {
+            auto vec = value.value<QVector3D>();
+            lanes[0] = vec.x(); lanes[1] = vec.y(); lanes[2] = vec.z();
+            break;
+        }
+        case QMetaType::QVector4D:
+        {
+            auto vec = value.value<QVector4D>();
+            lanes[0] = vec.x(); lanes[1] = vec.y(); lanes[2] = vec.z(); lanes[3] = vec.w();
+            break;
+        }
+        default:
+        {
+            auto list = value.toList();
+            for (int n = 0; n < width && n < list.size(); ++n)
+                 lanes[n] = list[n].toFloat();
+        }
+        }
+
+        return vec(lanes, width);
+    }
+    default:                return variant(type, value);
+    }
+}
+
+QVariant
+WPN114::Network::Value::
+to_variant() const
+{
+    switch (m_type)
+    {
+    case Type::Bool:        return m_data.b;
+    case Type::Int:         return m_data.i;
+    case Type::Int64:       return static_cast<qlonglong>(m_data.h);
+    case Type::Float:       return m_data.f[0];
+    case Type::Double:      return m_data.d;
+    case Type::String:      return QString::fromUtf8(m_bytes);
+    case Type::Blob:        return m_bytes;
+    case Type::Midi:        return static_cast<quint32>(m_data.h);
+    case Type::Timetag:     return static_cast<qulonglong>(m_data.h);
+    case Type::Char:        return QChar(static_cast<uint>(m_data.h));
+    case Type::Vec2f:       return QVector2D(m_data.f[0], m_data.f[1]);
+    case Type::Vec3f:       return QVector3D(m_data.f[0], m_data.f[1], m_data.f[2]);
+    case Type::Vec4f:       return QVector4D(m_data.f[0], m_data.f[1], m_data.f[2], m_data.f[3]);
+    default:                return m_variant;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+static bool
+read_number(OSCArgument const& argument, double& real, int64_t& integer)
+// numeric value of a single argument, false if it isn't one
+{
+    switch (argument.tag())
+    {
+    case 'i':
+    case 'c':   integer = argument.to_int(); real = integer; return true;
+    case 'm':   integer = static_cast<uint32_t>(argument.to_int()); real = integer; return true;
+    case 'h':
+    case 't':   integer = argument.to_int64(); real = integer; return true;
+    case 'f':   real = argument.to_float(); integer = static_cast<int64_t>(real); return true;
+    case 'd':   real = argument.to_double(); integer = static_cast<int64_t>(real); return true;
+    case 'T':   integer = 1; real = 1; return true;
+    case 'F':   integer = 0; real = 0; return true;
+    default:    return false;
+    }
+}
+
+Value
+WPN114::Network::Value::
+from_osc(OSCView const& message, Type::Values type)
+{
+    if (message.count() == 0 || !typed(type))
+        return variant(type, message.arguments());
+
+    auto argument = *message.begin();
+    double real = 0;
+    int64_t integer = 0;
+
+    switch (type)
+    {
+    case Type::String:
+    {
+        if (argument.tag() != 's' && argument.tag() != 'S')
+            break;
+
+        auto string = argument.to_string();
+        return bytes(type, QByteArray(string.data(), string.size()));
+    }
+    case Type::Blob:
+    {
+        if (argument.tag() != 'b')
+            break;
+
+        auto blob = argument.to_blob();
+        return bytes(type, QByteArray(blob.data(), blob.size()));
+    }
+    case Type::Vec2f:
+    case Type::Vec3f:
+    case Type::Vec4f:
+    {
+        float lanes[4] = { 0, 0, 0, 0 };
+        int width = type == Type::Vec2f ? 2 : type == Type::Vec3f ? 3 : 4;
+
+        // the usual case is a run of 'f' arguments, read in one go
+        int n = message.read(lanes, width);
+
+        if (n < width) {
+            // other numeric types, or too few arguments
+            n = 0;
+            for (auto it = message.begin(); it != message.end() && n < width; ++it, ++n)
+                 if (read_number(*it, real, integer))
+                     lanes[n] = static_cast<float>(real);
+        }
+
+        return vec(lanes, width);
+    }
+    default:
+    {
+        if (!read_number(argument, real, integer))
+            break;
+
+        switch (type)
+        {
+        case Type::Bool:    return integer != 0 || real != 0;
+        case Type::Int:     return static_cast<int32_t>(integer);
+        case Type::Int64:   return integer;
+        case Type::Float:   return static_cast<float>(real);
+        case Type::Double:  return real;
+        default:            return Value::integer(type, integer);
+        }
+    }
+    }
+
+    // arguments don't fit the node's type
+    return from_variant(message.arguments(), type);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <QObject>
+#include <QVariant>
+#include <QByteArray>
+#include <cstdint>
+
+namespace WPN114  {
+namespace Network {
+
+class OSCView;
+
+//=================================================================================================
+class Type : public QObject
+//=================================================================================================
+{
+    Q_OBJECT
+
+public:
+    enum Values
+    {
+        None        = 43,
+        Bool        = 1,
+        Int         = 2,
+        Float       = 6,
+        String      = 10,
+        List        = 9,
+        Vec2f       = 82,
+        Vec3f       = 83,
+        Vec4f       = 84,
+        Char        = 34,
+        Impulse     = 0,
+        File        = 11,
+        Int64       = 4,
+        Blob        = 12,
+        Color       = 67,
+        Double      = 128,  // no QMetaType equivalent: qml reals map to Float
+        Timetag     = 129,
+        Midi        = 130
+        // osc-only, kept clear of QMetaType ids (UInt, ULongLong) so that properties
+        // of those types aren't mistaken for them
+    };
+
+    Q_ENUM (Values)
+};
+
+//=================================================================================================
+class Value
+//=================================================================================================
+// typed node value: scalars and vectors are held inline, strings and blobs as utf8/raw bytes,
+// anything else (lists, colors, chars...) falls back to a QVariant.
+// this is what nodes, the value store and the OSC codec pass around,
+// QVariants are only created for QML (or JSON) when asked for
+{
+public:
+
+    //---------------------------------------------------------------------------------------------
+    Value() {}
+
+    Value(bool value) : m_type(Type::Bool) { m_data.b = value; }
+
+    Value(int32_t value) : m_type(Type::Int) { m_data.i = value; }
+
+    Value(int64_t value) : m_type(Type::Int64) { m_data.h = value; }
+
+    Value(float value) : m_type(Type::Float) { m_data.f[0] = value; }
+
+    Value(double value) : m_type(Type::Double) { m_data.d = value; }
+
+    Value(QString const& value) : m_type(Type::String), m_bytes(value.toUtf8()) {}
+
+    Value(const char*) = delete;
+    // would silently convert to bool
+
+    //---------------------------------------------------------------------------------------------
+    static Value
+    vec(const float* values, int width);
+    // Vec2f, Vec3f or Vec4f depending on width
+
+    static Value
+    bytes(Type::Values type, QByteArray const& bytes);
+    // String (utf8) or Blob
+
+    static Value
+    integer(Type::Values type, int64_t value);
+    // Midi, Char or Timetag
+
+    static Value
+    variant(Type::Values type, QVariant const& value);
+    // any other type
+
+    //---------------------------------------------------------------------------------------------
+    static Value
+    from_variant(QVariant const& value, Type::Values type);
+    // converts a qml/json value to a node of type 'type'
+
+    static Value
+    from_osc(OSCView const& message, Type::Values type);
+    // reads message arguments as a node of type 'type', without going through QVariant
+
+    QVariant
+    to_variant() const;
+
+    //---------------------------------------------------------------------------------------------
+    Type::Values
+    type() const { return m_type; }
+
+    bool
+    typed() const { return typed(m_type); }
+
+    static bool
+    typed(Type::Values type);
+    // false for types that are held as a QVariant
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    to_bool() const;
+
+    int32_t
+    to_int() const { return static_cast<int32_t>(to_int64()); }
+
+    int64_t
+    to_int64() const;
+
+    float
+    to_float() const { return static_cast<float>(to_double()); }
+
+    double
+    to_double() const;
+
+    //---------------------------------------------------------------------------------------------
+    const float*
+    vec() const { return m_data.f; }
+    // 4 lanes, those past width() are zero
+
+    int
+    width() const;
+
+    QByteArray const&
+    bytes() const { return m_bytes; }
+
+    QVariant const&
+    variant() const { return m_variant; }
+
+    //---------------------------------------------------------------------------------------------
+    bool
+    operator==(Value const& rhs) const;
+
+    bool
+    operator!=(Value const& rhs) const { return !(*this == rhs); }
+
+private:
+
+    //---------------------------------------------------------------------------------------------
+    union Data
+    {
+        float
+        f[4];
+
+        double
+        d;
+
+        int64_t
+        h;
+
+        int32_t
+        i;
+
+        bool
+        b;
+    };
+
+    Type::Values
+    m_type = Type::None;
+
+    Data
+    m_data = {};
+
+    QByteArray
+    m_bytes;
+
+    QVariant
+    m_variant;
+};
+
+}
+}